@@ -0,0 +1,223 @@
+
+#include "BinaryImage.h"
+#include "Rfl.h"
+#include "MurmurHash2.h"
+#include <algorithm>
+
+
+namespace
+{
+	// Can objects of the type be copied as they are in memory, with only their pointers patched?
+	bool CanImage(const rfl::Type* type)
+	{
+		type->Materialise();
+
+		switch (type->kind)
+		{
+		case rfl::Type::KIND_BASE_TYPE:
+		case rfl::Type::KIND_ENUM:
+			return true;
+
+		case rfl::Type::KIND_CLASS:
+		{
+			const rfl::Class* class_type = static_cast<const rfl::Class*>(type);
+			if (!class_type->is_pod)
+				return false;
+
+			// Whatever pointers point at is checked when they're written
+			const rfl::FieldTable& fields = class_type->field_table;
+			for (u32 i = 0; i < fields.count; i++)
+			{
+				if (fields.types[i] == 0 || (fields.flags[i] & rfl::FieldTable::FLAG_REFERENCE))
+					return false;
+				if (!(fields.flags[i] & rfl::FieldTable::FLAG_POINTER) && !CanImage(fields.types[i]))
+					return false;
+			}
+			return true;
+		}
+
+		default:
+			// Nothing is known about the layout of template instances
+			return false;
+		}
+	}
+
+
+	// Offsets of every pointer in objects of the class, including those in arrays and nested classes
+	void AddPointerOffsets(const rfl::Class* class_type, u32 base_offset, std::vector<u32>& offsets)
+	{
+		const rfl::FieldTable& fields = class_type->field_table;
+		for (u32 i = 0; i < fields.count; i++)
+		{
+			u32 offset = base_offset + fields.offsets[i];
+			const rfl::Type* field_type = fields.types[i];
+
+			if (fields.flags[i] & rfl::FieldTable::FLAG_POINTER)
+			{
+				for (u32 j = 0; j < fields.element_counts[i]; j++)
+					offsets.push_back(offset + j * sizeof(void*));
+			}
+			else if (field_type->kind == rfl::Type::KIND_CLASS)
+			{
+				for (u32 j = 0; j < fields.element_counts[i]; j++)
+					AddPointerOffsets(static_cast<const rfl::Class*>(field_type), offset + j * field_type->size, offsets);
+			}
+		}
+	}
+
+
+	void AddSchema(const rfl::Type* type, std::vector<u32>& schema)
+	{
+		schema.push_back(type->full_name.hash_id);
+		schema.push_back(type->kind);
+		schema.push_back(type->size);
+		if (type->kind != rfl::Type::KIND_CLASS)
+			return;
+
+		const rfl::FieldTable& fields = static_cast<const rfl::Class*>(type)->field_table;
+		schema.push_back(fields.count);
+		for (u32 i = 0; i < fields.count; i++)
+		{
+			const rfl::Field& field = static_cast<const rfl::Class*>(type)->fields[i];
+			schema.push_back(field.name.hash_id);
+			schema.push_back(fields.offsets[i]);
+			schema.push_back(fields.element_counts[i]);
+			schema.push_back(fields.flags[i]);
+
+			// Only the name of pointed to types matters
+			if (fields.flags[i] & rfl::FieldTable::FLAG_POINTER)
+				schema.push_back(fields.types[i]->full_name.hash_id);
+			else
+				AddSchema(fields.types[i], schema);
+		}
+	}
+}
+
+
+u32 serialise::GetImageSchemaHash(const rfl::Class* class_type)
+{
+	class_type->Materialise();
+
+	std::vector<u32> schema;
+	AddSchema(class_type, schema);
+	return MurmurHash2(&schema[0], int(schema.size() * sizeof(u32)), ImageHeader::VERSION);
+}
+
+
+bool serialise::WriteImage(const void* objects, u32 nb_objects, const rfl::Class* class_type, Writer& writer)
+{
+	if (!CanImage(class_type))
+		return false;
+
+	std::vector<u32> pointer_offsets;
+	AddPointerOffsets(class_type, 0, pointer_offsets);
+
+	// Loaders only accept relocations that are aligned and don't overlap, which packed classes and
+	// unions of pointers wouldn't give
+	std::sort(pointer_offsets.begin(), pointer_offsets.end());
+	for (size_t i = 0; i < pointer_offsets.size(); i++)
+	{
+		if (pointer_offsets[i] % sizeof(void*) != 0 || (i > 0 && pointer_offsets[i] < pointer_offsets[i - 1] + sizeof(void*)))
+			return false;
+	}
+
+	// Pointers are replaced with offsets in a copy of the objects
+	u64 total_size = (u64)nb_objects * class_type->size;
+	if (total_size > 0xFFFFFFFF)
+		return false;
+	u32 data_size = (u32)total_size;
+	const char* table_begin = (const char*)objects;
+	const char* table_end = table_begin + data_size;
+	std::vector<char> data(table_begin, table_end);
+
+	std::vector<u32> relocations;
+	for (u32 i = 0; i < nb_objects; i++)
+	{
+		for (size_t j = 0; j < pointer_offsets.size(); j++)
+		{
+			u32 offset = i * class_type->size + pointer_offsets[j];
+			const char* target;
+			memcpy(&target, &data[offset], sizeof(target));
+			if (target == 0)
+				continue;
+
+			// Pointers to the end of the table are allowed as they're often used to mark the end of ranges
+			if (target < table_begin || target > table_end)
+				return false;
+
+			size_t target_offset = target - table_begin;
+			memcpy(&data[offset], &target_offset, sizeof(target_offset));
+			relocations.push_back(offset);
+		}
+	}
+
+	ImageHeader header;
+	header.magic = ImageHeader::MAGIC;
+	header.version = ImageHeader::VERSION;
+	header.schema_hash = GetImageSchemaHash(class_type);
+	header.pointer_size = sizeof(void*);
+	header.object_size = class_type->size;
+	header.nb_objects = nb_objects;
+	header.nb_relocations = (u32)relocations.size();
+
+	u32 relocations_end = sizeof(ImageHeader) + header.nb_relocations * sizeof(u32);
+	header.data_offset = (relocations_end + ImageHeader::DATA_ALIGNMENT - 1) & ~(ImageHeader::DATA_ALIGNMENT - 1);
+
+	writer.Write(header);
+	if (header.nb_relocations)
+		writer.Write(&relocations[0], header.nb_relocations * sizeof(u32));
+
+	static const char padding[ImageHeader::DATA_ALIGNMENT] = { 0 };
+	writer.Write(padding, header.data_offset - relocations_end);
+
+	if (data_size)
+		writer.Write(&data[0], data_size);
+	return true;
+}
+
+
+void* serialise::LoadImage(void* image, u32 size, const rfl::Class* class_type, u32& nb_objects)
+{
+	nb_objects = 0;
+	if (size < sizeof(ImageHeader))
+		return 0;
+
+	const ImageHeader& header = *(const ImageHeader*)image;
+	if (header.magic != ImageHeader::MAGIC ||
+		header.version != ImageHeader::VERSION ||
+		header.pointer_size != sizeof(void*) ||
+		header.object_size != class_type->size ||
+		header.schema_hash != GetImageSchemaHash(class_type))
+	{
+		return 0;
+	}
+
+	// Reject truncated images before anything is patched
+	u64 data_size = (u64)header.nb_objects * header.object_size;
+	u64 relocations_end = sizeof(ImageHeader) + (u64)header.nb_relocations * sizeof(u32);
+	if (header.data_offset < relocations_end || header.data_offset + data_size > size)
+		return 0;
+
+	char* data = (char*)image + header.data_offset;
+	const u32* relocations = (const u32*)(&header + 1);
+	for (u32 i = 0; i < header.nb_relocations; i++)
+	{
+		// In u64 so that relocations near the top of the u32 range can't wrap round to pass
+		if ((u64)relocations[i] + sizeof(char*) > data_size || *(size_t*)(data + relocations[i]) > data_size)
+			return 0;
+
+		// Written in increasing order at pointer alignment, so anything else would patch a pointer
+		// twice or corrupt its neighbours
+		if (relocations[i] % sizeof(char*) != 0 || (i > 0 && relocations[i] < relocations[i - 1] + sizeof(char*)))
+			return 0;
+	}
+
+	for (u32 i = 0; i < header.nb_relocations; i++)
+	{
+		char** pointer = (char**)(data + relocations[i]);
+		*pointer = data + (size_t)*pointer;
+	}
+
+	nb_objects = header.nb_objects;
+	return data;
+}
@@ -0,0 +1,65 @@
+
+#pragma once
+
+
+#include "BinaryStream.h"
+
+
+namespace rfl
+{
+	struct Class;
+}
+
+
+namespace serialise
+{
+	//
+	// Images are tables of objects written exactly as they're laid out in memory, so that loading
+	// one is a single read or file mapping followed by patching any pointers between the objects.
+	// They're only valid for the layout they were written with, which is checked on load with a hash
+	// of the class's layout.
+	//
+	// The class and every class it contains by value must be POD, with no template instances.
+	// Pointer fields must be null or point into the table being written, and are stored as offsets
+	// from the start of the table. The relocation table lists where they are.
+	//
+	struct ImageHeader
+	{
+		enum
+		{
+			MAGIC = 0x494C4652,		// "RFLI" when viewed as little-endian bytes
+			VERSION = 1,
+
+			// Alignment of the objects relative to the start of the image
+			DATA_ALIGNMENT = 16,
+		};
+
+		u32 magic;
+		u32 version;
+		u32 schema_hash;
+		u32 pointer_size;
+
+		u32 object_size;
+		u32 nb_objects;
+
+		// Offsets into the objects of every non-null pointer, stored straight after the header
+		u32 nb_relocations;
+
+		// Offset of the objects from the start of the image
+		u32 data_offset;
+	};
+
+
+	// Hash of everything about the class's layout that its images depend on
+	u32 GetImageSchemaHash(const rfl::Class* class_type);
+
+	// Returns false, having written nothing, if the class can't be imaged or a pointer leads out of
+	// the table
+	bool WriteImage(const void* objects, u32 nb_objects, const rfl::Class* class_type, Writer& writer);
+
+	// Patch the pointers of an image in writable memory, such as a file read in full or mapped with
+	// Win32::MapFileCopyOnWrite, aligned to at least DATA_ALIGNMENT. Returns the first object, or
+	// null if the image isn't for the class's current layout. The objects stay in the image memory
+	// and are never constructed or destroyed. Each image can only be loaded once.
+	void* LoadImage(void* image, u32 size, const rfl::Class* class_type, u32& nb_objects);
+}
@@ -0,0 +1,478 @@
+
+#include "BinaryJit.h"
+#include "BinarySerialiser.h"
+#include "Rfl.h"
+#include "Win32.h"
+#include <cstddef>
+
+
+namespace
+{
+	// Larger copies call memcpy through the writer or reader instead of being unrolled
+	const u32 MAX_INLINE_COPY = 64;
+
+
+	//
+	// Compiled functions are cdecl with the signature of rfl::Type::serialise_func and keep
+	// the object in esi, the writer or reader in edi and array loop state in ebx and ebp, all of
+	// which are callee-saved. Offsets of the arguments once all four have been pushed:
+	//
+	enum
+	{
+		ARG_OBJECT = 24,
+		ARG_STREAM = 28,
+	};
+
+
+	// x86 registers as encoded in instructions
+	enum
+	{
+		EAX = 0,
+		ECX = 1,
+		EDX = 2,
+		EBX = 3,
+		ESP = 4,
+		EBP = 5,
+		ESI = 6,
+		EDI = 7,
+	};
+
+
+	// Called from compiled code for everything that isn't inlined
+
+	void WriteBytes(serialise::Writer& writer, const char* data, u32 size)
+	{
+		writer.Write(data, size);
+	}
+
+
+	void ReadBytes(serialise::Reader& reader, char* data, u32 size)
+	{
+		reader.Read(data, size);
+	}
+
+
+	// Code compiled from a plan that has since been rebuilt or gone stale falls back to the interpreter
+	bool IsPlanCompiled(const rfl::Class* class_type, const rfl::SerialisePlan::Op* ops)
+	{
+		const rfl::SerialisePlan& plan = class_type->serialise_plan;
+		return plan.IsCurrent() && plan.ops.data == ops;
+	}
+
+
+	void (*const g_BinarySerialise)(const char*, const rfl::Class*, serialise::Writer&) = serialise::BinarySerialise;
+	void (*const g_BinaryDeserialise)(char*, const rfl::Class*, serialise::Reader&) = serialise::BinaryDeserialise;
+
+
+	// Compiled classes keep being deserialised as views field by field, as they were before
+	// the compiled code made them look like they have their own serialise functions
+
+	void DeserialiseView(const rfl::Type* type, void* object, serialise::Reader& reader)
+	{
+		serialise::BinaryDeserialiseView((char*)object, static_cast<const rfl::Class*>(type), reader);
+	}
+
+
+	void ReleaseView(const rfl::Type* type, void* object, const serialise::Reader& reader)
+	{
+		serialise::BinaryReleaseView((char*)object, static_cast<const rfl::Class*>(type), reader);
+	}
+
+
+	bool CanCompile(const rfl::Type* type)
+	{
+		if (type->kind != rfl::Type::KIND_CLASS)
+			return false;
+
+		type->Materialise();
+		if ((type->traits & (rfl::Type::TRAIT_DEEP_POD | rfl::Type::TRAIT_CUSTOM_SERIALISER)) || !(type->traits & rfl::Type::TRAIT_BUILT))
+			return false;
+
+		return static_cast<const rfl::Class*>(type)->serialise_plan.IsCurrent();
+	}
+}
+
+
+namespace serialise
+{
+	//
+	// Emits the code for the classes compiled by a single call to JitCache::Compile into one block
+	//
+	struct JitCompiler
+	{
+		JitCompiler(JitCache& cache) : cache(cache)
+		{
+		}
+
+		void CompileClass(const rfl::Class* class_type)
+		{
+			Function& function = functions[class_type];
+			function.class_type = class_type;
+			function.compiled = false;
+
+			// Contained classes are compiled first so that they can be called directly. Those that are
+			// still being compiled when they're reached again are called through BinarySerialiseObject.
+			const rfl::SerialisePlan& plan = class_type->serialise_plan;
+			for (u32 i = 0; i < plan.ops.count; i++)
+			{
+				const rfl::Type* type = plan.ops[i].type;
+				if (plan.ops[i].code != rfl::SerialisePlan::OP_COPY &&
+					cache.entries.find(type) == cache.entries.end() &&
+					functions.find(type) == functions.end() &&
+					CanCompile(type))
+				{
+					CompileClass(static_cast<const rfl::Class*>(type));
+				}
+			}
+
+			function.serialise_offset = EmitFunction(class_type, true);
+			function.deserialise_offset = EmitFunction(class_type, false);
+			function.compiled = true;
+		}
+
+		// Copy the code to executable memory and set it as the serialise functions of the compiled classes
+		bool Finish()
+		{
+			void* block = Win32::AllocCode((u32)code.size());
+			if (block == 0)
+				return false;
+			u8* base = (u8*)block;
+			memcpy(base, &code[0], code.size());
+
+			for (size_t i = 0; i < calls.size(); i++)
+			{
+				u32 rel = u32((const u8*)calls[i].target - (base + calls[i].position + 4));
+				memcpy(base + calls[i].position, &rel, sizeof(rel));
+			}
+
+			if (!Win32::ProtectCode(block, (u32)code.size()))
+			{
+				Win32::FreeCode(block);
+				return false;
+			}
+			cache.code_blocks.push_back(block);
+
+			for (std::map<const rfl::Type*, Function>::iterator i = functions.begin(); i != functions.end(); ++i)
+			{
+				JitCache::Entry entry = { base + i->second.serialise_offset, base + i->second.deserialise_offset };
+				cache.entries[i->first] = entry;
+
+				rfl::Type* type = const_cast<rfl::Type*>(i->first);
+				type->SetSerialiseFuncs(
+					(void (*)(const rfl::Type*, const void*, Writer&))entry.serialise,
+					(void (*)(const rfl::Type*, void*, Reader&))entry.deserialise);
+				if (type->deserialise_view_func == 0 && type->release_view_func == 0)
+					type->SetViewFuncs(DeserialiseView, ReleaseView);
+			}
+
+			return true;
+		}
+
+		u32 EmitFunction(const rfl::Class* class_type, bool write)
+		{
+			u32 start = (u32)code.size();
+
+			// push ebx; push ebp; push esi; push edi
+			Emit8(0x53);
+			Emit8(0x55);
+			Emit8(0x56);
+			Emit8(0x57);
+
+			// mov esi, [esp + ARG_OBJECT]; mov edi, [esp + ARG_STREAM]
+			EmitModRM(0x8B, 1, ESI, ESP);
+			Emit8(0x24);
+			Emit8(ARG_OBJECT);
+			EmitModRM(0x8B, 1, EDI, ESP);
+			Emit8(0x24);
+			Emit8(ARG_STREAM);
+
+			// Check that the plan is the one being compiled
+			const rfl::SerialisePlan& plan = class_type->serialise_plan;
+			EmitPushImm(plan.ops.data);
+			EmitPushImm(class_type);
+			EmitCall(IsPlanCompiled);
+			EmitAddEsp(8);
+			// test al, al; jz fallback
+			Emit8(0x84);
+			Emit8(0xC0);
+			u32 fallback = EmitJump(0x84);
+
+			for (u32 i = 0; i < plan.ops.count; i++)
+			{
+				const rfl::SerialisePlan::Op& op = plan.ops[i];
+				switch (op.code)
+				{
+				case rfl::SerialisePlan::OP_COPY:
+					EmitCopy(op.offset, op.size, write);
+					break;
+
+				case rfl::SerialisePlan::OP_OBJECT:
+					// lea eax, [esi + offset]
+					EmitModRM(0x8D, 2, EAX, ESI);
+					Emit32(op.offset);
+					EmitObjectCall(op.type, EAX, write);
+					break;
+
+				case rfl::SerialisePlan::OP_OBJECT_ARRAY:
+				{
+					// The loop runs at least once
+					if (op.size == 0)
+						break;
+
+					// lea ebx, [esi + offset]; mov ebp, count
+					EmitModRM(0x8D, 2, EBX, ESI);
+					Emit32(op.offset);
+					Emit8(0xB8 + EBP);
+					Emit32(op.size);
+
+					u32 loop = (u32)code.size();
+					EmitObjectCall(op.type, EBX, write);
+
+					// add ebx, size; dec ebp; jnz loop
+					EmitModRM(0x81, 3, 0, EBX);
+					Emit32(op.type->size);
+					Emit8(0x48 + EBP);
+					u32 jump = EmitJump(0x85);
+					PatchJump(jump, loop);
+					break;
+				}
+				}
+			}
+
+			EmitReturn();
+
+			// Hand the object to the interpreter
+			PatchJump(fallback, (u32)code.size());
+			Emit8(0x57);
+			EmitPushImm(class_type);
+			Emit8(0x56);
+			if (write)
+				EmitCall(g_BinarySerialise);
+			else
+				EmitCall(g_BinaryDeserialise);
+			EmitAddEsp(12);
+			EmitReturn();
+
+			return start;
+		}
+
+		// Inline the fast path of Writer::Write or Reader::Read, calling them when the buffer is too small
+		void EmitCopy(u32 offset, u32 size, bool write)
+		{
+			u32 done = 0;
+			if (size <= MAX_INLINE_COPY)
+			{
+				u32 pos_offset = write ? offsetof(Writer, pos) : offsetof(Reader, pos);
+				u32 end_offset = write ? offsetof(Writer, end) : offsetof(Reader, end);
+
+				// mov eax, [edi + pos]; lea edx, [eax + size]; cmp edx, [edi + end]; ja slow
+				EmitModRM(0x8B, 2, EAX, EDI);
+				Emit32(pos_offset);
+				EmitModRM(0x8D, 2, EDX, EAX);
+				Emit32(size);
+				EmitModRM(0x3B, 2, EDX, EDI);
+				Emit32(end_offset);
+				u32 slow = EmitJump(0x87);
+
+				// Copy through ecx a dword at a time, then any bytes left over
+				for (u32 i = 0; i < size; )
+				{
+					u32 nb_bytes = size - i >= 4 ? 4 : 1;
+					u8 load = nb_bytes == 4 ? 0x8B : 0x8A;
+					u8 store = nb_bytes == 4 ? 0x89 : 0x88;
+					EmitModRM(load, 2, ECX, write ? ESI : EAX);
+					Emit32(write ? offset + i : i);
+					EmitModRM(store, 2, ECX, write ? EAX : ESI);
+					Emit32(write ? i : offset + i);
+					i += nb_bytes;
+				}
+
+				// mov [edi + pos], edx; jmp done
+				EmitModRM(0x89, 2, EDX, EDI);
+				Emit32(pos_offset);
+				Emit8(0xE9);
+				done = (u32)code.size();
+				Emit32(0);
+
+				PatchJump(slow, (u32)code.size());
+			}
+
+			// push size; lea eax, [esi + offset]; push eax; push edi
+			Emit8(0x68);
+			Emit32(size);
+			EmitModRM(0x8D, 2, EAX, ESI);
+			Emit32(offset);
+			Emit8(0x50);
+			Emit8(0x57);
+			if (write)
+				EmitCall(WriteBytes);
+			else
+				EmitCall(ReadBytes);
+			EmitAddEsp(12);
+
+			if (done)
+				PatchJump(done, (u32)code.size());
+		}
+
+		// Serialise the object at the address in the register, calling compiled code directly where
+		// there is any
+		void EmitObjectCall(const rfl::Type* type, u32 object_reg, bool write)
+		{
+			std::map<const rfl::Type*, JitCache::Entry>::const_iterator entry = cache.entries.find(type);
+			std::map<const rfl::Type*, Function>::const_iterator function = functions.find(type);
+
+			// push edi
+			Emit8(0x57);
+
+			if (entry != cache.entries.end())
+			{
+				Emit8(0x50 + object_reg);
+				EmitPushImm(type);
+				EmitCall(write ? entry->second.serialise : entry->second.deserialise);
+			}
+
+			else if (function != functions.end() && function->second.compiled)
+			{
+				Emit8(0x50 + object_reg);
+				EmitPushImm(type);
+				EmitLocalCall(write ? function->second.serialise_offset : function->second.deserialise_offset);
+			}
+
+			else
+			{
+				EmitPushImm(type);
+				Emit8(0x50 + object_reg);
+				if (write)
+					EmitCall(BinarySerialiseObject);
+				else
+					EmitCall(BinaryDeserialiseObject);
+			}
+
+			EmitAddEsp(12);
+		}
+
+		void EmitReturn()
+		{
+			// pop edi; pop esi; pop ebp; pop ebx; ret
+			Emit8(0x5F);
+			Emit8(0x5E);
+			Emit8(0x5D);
+			Emit8(0x5B);
+			Emit8(0xC3);
+		}
+
+		void Emit8(u32 value)
+		{
+			code.push_back((u8)value);
+		}
+
+		void Emit32(u32 value)
+		{
+			u8 bytes[4];
+			memcpy(bytes, &value, sizeof(bytes));
+			code.insert(code.end(), bytes, bytes + 4);
+		}
+
+		void EmitModRM(u32 opcode, u32 mod, u32 reg, u32 rm)
+		{
+			Emit8(opcode);
+			Emit8((mod << 6) | (reg << 3) | rm);
+		}
+
+		void EmitPushImm(const void* value)
+		{
+			Emit8(0x68);
+			Emit32((u32)(size_t)value);
+		}
+
+		void EmitAddEsp(u32 nb_bytes)
+		{
+			EmitModRM(0x83, 3, 0, ESP);
+			Emit8(nb_bytes);
+		}
+
+		// Calls outside the block are patched once its address is known
+		template <typename FUNC> void EmitCall(FUNC func)
+		{
+			Emit8(0xE8);
+			Call call = { (u32)code.size(), (const void*)func };
+			calls.push_back(call);
+			Emit32(0);
+		}
+
+		void EmitLocalCall(u32 offset)
+		{
+			Emit8(0xE8);
+			Emit32(offset - u32(code.size() + 4));
+		}
+
+		// Emit a conditional jump with the given second opcode byte, returning where to patch its target
+		u32 EmitJump(u32 condition)
+		{
+			Emit8(0x0F);
+			Emit8(condition);
+			u32 position = (u32)code.size();
+			Emit32(0);
+			return position;
+		}
+
+		void PatchJump(u32 position, u32 target)
+		{
+			u32 rel = target - (position + 4);
+			memcpy(&code[position], &rel, sizeof(rel));
+		}
+
+		JitCache& cache;
+
+		struct Function
+		{
+			const rfl::Class* class_type;
+			u32 serialise_offset;
+			u32 deserialise_offset;
+
+			// Not set while the classes it contains are being compiled
+			bool compiled;
+		};
+
+		std::map<const rfl::Type*, Function> functions;
+
+		std::vector<u8> code;
+
+		struct Call
+		{
+			u32 position;
+			const void* target;
+		};
+
+		std::vector<Call> calls;
+	};
+}
+
+
+serialise::JitCache::~JitCache()
+{
+	for (std::map<const rfl::Type*, Entry>::iterator i = entries.begin(); i != entries.end(); ++i)
+	{
+		rfl::Type* type = const_cast<rfl::Type*>(i->first);
+		if (type->serialise_func == i->second.serialise)
+			type->SetSerialiseFuncs(0, 0);
+		if (type->deserialise_view_func == DeserialiseView)
+			type->SetViewFuncs(0, 0);
+	}
+
+	for (size_t i = 0; i < code_blocks.size(); i++)
+		Win32::FreeCode(code_blocks[i]);
+}
+
+
+bool serialise::JitCache::Compile(const rfl::Class* class_type)
+{
+	if (entries.find(class_type) != entries.end())
+		return true;
+	if (!CanCompile(class_type))
+		return false;
+
+	JitCompiler compiler(*this);
+	compiler.CompileClass(class_type);
+	return compiler.Finish();
+}
@@ -0,0 +1,66 @@
+
+#pragma once
+
+
+#include "Core.h"
+#include <map>
+#include <vector>
+
+
+namespace rfl
+{
+	struct Type;
+	struct Class;
+}
+
+
+namespace serialise
+{
+	//
+	// Compiles the serialise plans of classes to x86 machine code, specialised on their exact offsets,
+	// sizes and field types. Copies are inlined against the writer and reader buffers and compiled
+	// classes call each other directly, leaving only template instances and custom serialisers to be
+	// dispatched through BinarySerialiseObject.
+	//
+	// The compiled code is set as the class's serialise functions, so it's used by BinarySerialiseObject
+	// and by every class that contains the compiled class. BinarySerialise and BinaryDeserialise keep
+	// running the plan interpreter, which the compiled code falls back to if the class's plan is
+	// rebuilt or goes stale.
+	//
+	// Compiling isn't thread-safe with serialisation of the same types on other threads. Compiled code
+	// calls that of the classes it contains directly, so replacing the serialise functions of a compiled
+	// class isn't seen by the classes containing it.
+	//
+	struct JitCache
+	{
+		JitCache()
+		{
+		}
+
+		// Restores the serialise functions of every compiled class and frees their code, so must be
+		// destroyed before the modules of the classes are unloaded
+		~JitCache();
+
+		// Compile the class and any classes it contains that haven't already been compiled, returning
+		// false if the class can't be compiled. Deep POD classes are left as they are as they're already
+		// serialised with a single copy, as are classes with their own serialise functions and those
+		// without an up to date plan.
+		bool Compile(const rfl::Class* class_type);
+
+		struct Entry
+		{
+			const void* serialise;
+			const void* deserialise;
+		};
+
+		// Compiled code for each compiled class
+		std::map<const rfl::Type*, Entry> entries;
+
+		// Executable memory allocated for each call to Compile
+		std::vector<void*> code_blocks;
+
+	private:
+		JitCache(const JitCache&);
+		JitCache& operator = (const JitCache&);
+	};
+}
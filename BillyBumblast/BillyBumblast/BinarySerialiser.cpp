@@ -3,121 +3,320 @@
 #include "Rfl.h"
 
 
-void serialise::BinarySerialiseObject(const char* object, const rfl::Type* type, std::ostream& ostream)
+namespace
 {
-	if (type->serialise_func)
+	// Serialisation of each kind of type that doesn't have custom serialise functions
+
+
+	void SerialiseNothing(const char*, const rfl::Type*, serialise::Writer&)
 	{
-		type->serialise_func(type, object, ostream);
 	}
 
-	else if (type->type == rfl::TypeOf<rfl::BaseType>())
+
+	void SerialiseRaw(const char* object, const rfl::Type* type, serialise::Writer& writer)
 	{
-		ostream.write(object, type->size);
+		writer.Write(object, type->size);
 	}
 
-	else if (type->type == rfl::TypeOf<rfl::Class>())
+
+	void SerialiseClass(const char* object, const rfl::Type* type, serialise::Writer& writer)
 	{
-		serialise::BinarySerialise(object, static_cast<const rfl::Class*>(type), ostream);
+		serialise::BinarySerialise(object, static_cast<const rfl::Class*>(type), writer);
 	}
 
-	else if (type->type == rfl::TypeOf<rfl::TemplateInstance>())
+
+	void SerialiseTemplateInstance(const char* object, const rfl::Type* type, serialise::Writer& writer)
 	{
 		rfl::Type* template_type = static_cast<const rfl::TemplateInstance*>(type)->instance_of;
 		if (template_type->serialise_func)
 		{
-			template_type->serialise_func(type, object, ostream);
+			template_type->serialise_func(type, object, writer);
 		}
 	}
-}
 
 
-void serialise::BinarySerialise(const char* object, const rfl::Class* class_type, std::ostream& ostream)
-{
-	const std::vector<rfl::Field>& fields = class_type->fields;
-	for (size_t i = 0; i < fields.size(); i++)
+	void DeserialiseNothing(char*, const rfl::Type*, serialise::Reader&)
+	{
+	}
+
+
+	void DeserialiseRaw(char* object, const rfl::Type* type, serialise::Reader& reader)
+	{
+		reader.Read(object, type->size);
+	}
+
+
+	void DeserialiseClass(char* object, const rfl::Type* type, serialise::Reader& reader)
 	{
-		const rfl::Field& field = fields[i];
+		serialise::BinaryDeserialise(object, static_cast<const rfl::Class*>(type), reader);
+	}
+
+
+	void DeserialiseTemplateInstance(char* object, const rfl::Type* type, serialise::Reader& reader)
+	{
+		rfl::Type* template_type = static_cast<const rfl::TemplateInstance*>(type)->instance_of;
+		if (template_type->deserialise_func)
+		{
+			template_type->deserialise_func(type, object, reader);
+		}
+	}
+
 
-		if (field.array_rank)
+	// Walk the fields one at a time, for classes whose serialise plan is out of date
+	void SerialiseFields(const char* object, const rfl::Class* class_type, serialise::Writer& writer)
+	{
+		const rfl::FieldTable& fields = class_type->field_table;
+		for (u32 i = 0; i < fields.count; i++)
 		{
-			u32 total_array_length = field.array_length_0 * field.array_length_1;
-			u32 entry_size = field.type->size;
+			const char* field_object = object + fields.offsets[i];
+			const rfl::Type* field_type = fields.types[i];
+
+			// Skipped like the plan builder does so that streams don't depend on whether the plan is current
+			if (field_type == 0)
+				continue;
+			field_type->Materialise();
 
-			if (field.type->constructor == 0)
+			if (fields.flags[i] & rfl::FieldTable::FLAG_ARRAY)
 			{
-				ostream.write(object + field.offset, total_array_length * entry_size);
+				u32 total_array_length = fields.element_counts[i];
+				u32 entry_size = field_type->size;
+
+				if (!(field_type->traits & rfl::Type::TRAIT_NEEDS_CONSTRUCT))
+				{
+					writer.Write(field_object, total_array_length * entry_size);
+				}
+				else
+				{
+					for (u32 j = 0; j < total_array_length; j++)
+					{
+						serialise::BinarySerialiseObject(field_object + j * entry_size, field_type, writer);
+					}
+				}
 			}
 			else
 			{
-				for (u32 j = 0; j < total_array_length; j++)
+				serialise::BinarySerialiseObject(field_object, field_type, writer);
+			}
+		}
+	}
+
+
+	typedef void (*DeserialiseObjectFunc)(char* object, const rfl::Type* type, serialise::Reader& reader);
+
+
+	void DeserialiseFields(char* object, const rfl::Class* class_type, serialise::Reader& reader, DeserialiseObjectFunc deserialise_object)
+	{
+		const rfl::FieldTable& fields = class_type->field_table;
+		for (u32 i = 0; i < fields.count; i++)
+		{
+			char* field_object = object + fields.offsets[i];
+			const rfl::Type* field_type = fields.types[i];
+
+			// Skipped like the plan builder does so that streams don't depend on whether the plan is current
+			if (field_type == 0)
+				continue;
+			field_type->Materialise();
+
+			if (fields.flags[i] & rfl::FieldTable::FLAG_ARRAY)
+			{
+				u32 total_array_length = fields.element_counts[i];
+				u32 entry_size = field_type->size;
+
+				if (!(field_type->traits & rfl::Type::TRAIT_NEEDS_CONSTRUCT))
 				{
-					BinarySerialiseObject(object + field.offset + j * entry_size, field.type, ostream);
+					reader.Read(field_object, total_array_length * entry_size);
 				}
+				else
+				{
+					for (u32 j = 0; j < total_array_length; j++)
+					{
+						deserialise_object(field_object + j * entry_size, field_type, reader);
+					}
+				}
+			}
+			else
+			{
+				deserialise_object(field_object, field_type, reader);
 			}
 		}
-		else
+	}
+
+
+	// Run the class's serialise plan, handing the objects in it to the given function
+	void DeserialisePlan(char* object, const rfl::Class* class_type, serialise::Reader& reader, DeserialiseObjectFunc deserialise_object)
+	{
+		class_type->Materialise();
+
+		const rfl::SerialisePlan& plan = class_type->serialise_plan;
+		if (!plan.IsCurrent())
+		{
+			DeserialiseFields(object, class_type, reader, deserialise_object);
+			return;
+		}
+
+		for (u32 i = 0; i < plan.ops.count; i++)
 		{
-			BinarySerialiseObject(object + field.offset, field.type, ostream);
+			const rfl::SerialisePlan::Op& op = plan.ops[i];
+			char* op_object = object + op.offset;
+
+			switch (op.code)
+			{
+			case rfl::SerialisePlan::OP_COPY:
+				reader.Read(op_object, op.size);
+				break;
+
+			case rfl::SerialisePlan::OP_OBJECT:
+				deserialise_object(op_object, op.type, reader);
+				break;
+
+			case rfl::SerialisePlan::OP_OBJECT_ARRAY:
+				for (u32 j = 0; j < op.size; j++)
+					deserialise_object(op_object + j * op.type->size, op.type, reader);
+				break;
+			}
 		}
 	}
-}
 
 
-void serialise::BinaryDeserialiseObject(char* object, const rfl::Type* type, std::istream& istream)
-{
-	if (type->deserialise_func)
+	// Template instances share the view functions of their template unless they have their own
+	const rfl::Type* GetViewFuncsType(const rfl::Type* type)
 	{
-		type->deserialise_func(type, object, istream);
+		if (type->kind == rfl::Type::KIND_TEMPLATE_INSTANCE && type->deserialise_view_func == 0)
+			return static_cast<const rfl::TemplateInstance*>(type)->instance_of;
+		return type;
 	}
 
-	else if (type->type == rfl::TypeOf<rfl::BaseType>())
+
+	// Indexed by rfl::Type::Kind
+	void (*const g_SerialiseFuncs[rfl::Type::NB_KINDS])(const char*, const rfl::Type*, serialise::Writer&) =
 	{
-		istream.read(object, type->size);
-	}
+		SerialiseRaw,
+		SerialiseClass,
+		SerialiseNothing,
+		SerialiseTemplateInstance,
+		SerialiseRaw,
+	};
+
+
+	void (*const g_DeserialiseFuncs[rfl::Type::NB_KINDS])(char*, const rfl::Type*, serialise::Reader&) =
+	{
+		DeserialiseRaw,
+		DeserialiseClass,
+		DeserialiseNothing,
+		DeserialiseTemplateInstance,
+		DeserialiseRaw,
+	};
+}
+
+
+void serialise::BinarySerialiseObject(const char* object, const rfl::Type* type, serialise::Writer& writer)
+{
+	if (type->traits & rfl::Type::TRAIT_CUSTOM_SERIALISER)
+		type->serialise_func(type, object, writer);
+	else
+		g_SerialiseFuncs[type->kind](object, type, writer);
+}
+
+
+void serialise::BinarySerialise(const char* object, const rfl::Class* class_type, serialise::Writer& writer)
+{
+	class_type->Materialise();
 
-	else if (type->type == rfl::TypeOf<rfl::Class>())
+	const rfl::SerialisePlan& plan = class_type->serialise_plan;
+	if (!plan.IsCurrent())
 	{
-		BinaryDeserialise(object, static_cast<const rfl::Class*>(type), istream);
+		SerialiseFields(object, class_type, writer);
+		return;
 	}
 
-	else if (type->type == rfl::TypeOf<rfl::TemplateInstance>())
+	for (u32 i = 0; i < plan.ops.count; i++)
 	{
-		rfl::Type* template_type = static_cast<const rfl::TemplateInstance*>(type)->instance_of;
-		if (template_type->deserialise_func)
+		const rfl::SerialisePlan::Op& op = plan.ops[i];
+		const char* op_object = object + op.offset;
+
+		switch (op.code)
 		{
-			template_type->deserialise_func(type, object, istream);
+		case rfl::SerialisePlan::OP_COPY:
+			writer.Write(op_object, op.size);
+			break;
+
+		case rfl::SerialisePlan::OP_OBJECT:
+			BinarySerialiseObject(op_object, op.type, writer);
+			break;
+
+		case rfl::SerialisePlan::OP_OBJECT_ARRAY:
+			for (u32 j = 0; j < op.size; j++)
+				BinarySerialiseObject(op_object + j * op.type->size, op.type, writer);
+			break;
 		}
 	}
 }
 
 
-void serialise::BinaryDeserialise(char* object, const rfl::Class* class_type, std::istream& istream)
+void serialise::BinaryDeserialiseObject(char* object, const rfl::Type* type, serialise::Reader& reader)
+{
+	if (type->traits & rfl::Type::TRAIT_CUSTOM_SERIALISER)
+		type->deserialise_func(type, object, reader);
+	else
+		g_DeserialiseFuncs[type->kind](object, type, reader);
+}
+
+
+void serialise::BinaryDeserialise(char* object, const rfl::Class* class_type, serialise::Reader& reader)
+{
+	DeserialisePlan(object, class_type, reader, BinaryDeserialiseObject);
+}
+
+
+void serialise::BinaryDeserialiseObjectView(char* object, const rfl::Type* type, serialise::Reader& reader)
+{
+	const rfl::Type* view_type = GetViewFuncsType(type);
+	if (view_type->deserialise_view_func)
+		view_type->deserialise_view_func(type, object, reader);
+	else if (type->kind == rfl::Type::KIND_CLASS && !(type->traits & rfl::Type::TRAIT_CUSTOM_SERIALISER))
+		BinaryDeserialiseView(object, static_cast<const rfl::Class*>(type), reader);
+	else
+		BinaryDeserialiseObject(object, type, reader);
+}
+
+
+void serialise::BinaryDeserialiseView(char* object, const rfl::Class* class_type, serialise::Reader& reader)
+{
+	DeserialisePlan(object, class_type, reader, BinaryDeserialiseObjectView);
+}
+
+
+void serialise::BinaryReleaseObjectView(char* object, const rfl::Type* type, const serialise::Reader& reader)
 {
-	const std::vector<rfl::Field>& fields = class_type->fields;
-	for (size_t i = 0; i < fields.size(); i++)
+	// Deep POD classes are always copied so can't reference the reader's memory
+	const rfl::Type* view_type = GetViewFuncsType(type);
+	if (view_type->release_view_func)
+		view_type->release_view_func(type, object, reader);
+	else if (type->kind == rfl::Type::KIND_CLASS && !(type->traits & (rfl::Type::TRAIT_CUSTOM_SERIALISER | rfl::Type::TRAIT_DEEP_POD)))
+		BinaryReleaseView(object, static_cast<const rfl::Class*>(type), reader);
+}
+
+
+void serialise::BinaryReleaseView(char* object, const rfl::Class* class_type, const serialise::Reader& reader)
+{
+	// Arrays that were read as raw bytes are skipped like everything else that was copied
+	const rfl::FieldTable& fields = class_type->field_table;
+	for (u32 i = 0; i < fields.count; i++)
 	{
-		const rfl::Field& field = fields[i];
+		char* field_object = object + fields.offsets[i];
+		const rfl::Type* field_type = fields.types[i];
+		if (field_type == 0)
+			continue;
+		field_type->Materialise();
 
-		if (field.array_rank)
+		if (!(fields.flags[i] & rfl::FieldTable::FLAG_ARRAY))
 		{
-			u32 total_array_length = field.array_length_0 * field.array_length_1;
-			u32 entry_size = field.type->size;
-
-			if (field.type->constructor == 0)
-			{
-				istream.read(object + field.offset, total_array_length * entry_size);
-			}
-			else
-			{
-				for (u32 j = 0; j < total_array_length; j++)
-				{
-					BinaryDeserialiseObject(object + field.offset + j * entry_size, field.type, istream);
-				}
-			}
+			BinaryReleaseObjectView(field_object, field_type, reader);
 		}
-		else
+		else if (field_type->traits & rfl::Type::TRAIT_NEEDS_CONSTRUCT)
 		{
-			BinaryDeserialiseObject(object + field.offset, field.type, istream);
+			for (u32 j = 0; j < fields.element_counts[i]; j++)
+				BinaryReleaseObjectView(field_object + j * field_type->size, field_type, reader);
 		}
 	}
-}
\ No newline at end of file
+}
@@ -2,7 +2,7 @@
 #pragma once
 
 
-#include <iosfwd>
+#include "BinaryStream.h"
 
 
 namespace rfl
@@ -14,40 +14,47 @@ namespace rfl
 
 namespace serialise
 {
-	void BinarySerialise(const char* object, const rfl::Class* class_type, std::ostream& ostream);
-	void BinarySerialiseObject(const char* object, const rfl::Type* type, std::ostream& ostream);
-	void BinaryDeserialise(char* object, const rfl::Class* class_type, std::istream& istream);
-	void BinaryDeserialiseObject(char* object, const rfl::Type* type, std::istream& istream);
+	void BinarySerialise(const char* object, const rfl::Class* class_type, Writer& writer);
+	void BinarySerialiseObject(const char* object, const rfl::Type* type, Writer& writer);
+	void BinaryDeserialise(char* object, const rfl::Class* class_type, Reader& reader);
+	void BinaryDeserialiseObject(char* object, const rfl::Type* type, Reader& reader);
 
+	// Read-only deserialisation for data that outlives the objects, such as a mapped file. Types with
+	// view functions reference the reader's memory instead of copying from it, so objects must be
+	// released with the same reader before they're destroyed or deserialised into again.
+	void BinaryDeserialiseView(char* object, const rfl::Class* class_type, Reader& reader);
+	void BinaryDeserialiseObjectView(char* object, const rfl::Type* type, Reader& reader);
+	void BinaryReleaseView(char* object, const rfl::Class* class_type, const Reader& reader);
+	void BinaryReleaseObjectView(char* object, const rfl::Type* type, const Reader& reader);
 
-	template <typename TYPE> void BinarySerialise(const TYPE& object, std::ostream& ostream)
+
+	template <typename TYPE> void BinarySerialise(const TYPE& object, Writer& writer)
 	{
 		rfl::Type* type = rfl::TypeOf<TYPE>();
 		rfl::Class* class_type = rfl::ExactCast<rfl::Class>(type);
-		BinarySerialise((const char*)&object, class_type, ostream);
+		BinarySerialise((const char*)&object, class_type, writer);
 	}
 
 
-	template <typename TYPE> void BinaryDeserialise(TYPE& object, std::istream& istream)
+	template <typename TYPE> void BinaryDeserialise(TYPE& object, Reader& reader)
 	{
 		rfl::Type* type = rfl::TypeOf<TYPE>();
 		rfl::Class* class_type = rfl::ExactCast<rfl::Class>(type);
-		BinaryDeserialise((char*)&object, class_type, istream);
+		BinaryDeserialise((char*)&object, class_type, reader);
 	}
 
-	// TEMP: Should these be here?
-
-	template <typename TYPE> TYPE Read(std::istream& istream)
+	template <typename TYPE> void BinaryDeserialiseView(TYPE& object, Reader& reader)
 	{
-		TYPE temp;
-		istream.read((char*)&temp, sizeof(temp));
-		return temp;
+		rfl::Type* type = rfl::TypeOf<TYPE>();
+		rfl::Class* class_type = rfl::ExactCast<rfl::Class>(type);
+		BinaryDeserialiseView((char*)&object, class_type, reader);
 	}
 
 
-	template <typename TYPE> void Write(std::ostream& ostream, const TYPE& value)
+	template <typename TYPE> void BinaryReleaseView(TYPE& object, const Reader& reader)
 	{
-		ostream.write((char*)&value, sizeof(value));
+		rfl::Type* type = rfl::TypeOf<TYPE>();
+		rfl::Class* class_type = rfl::ExactCast<rfl::Class>(type);
+		BinaryReleaseView((char*)&object, class_type, reader);
 	}
-
 }
\ No newline at end of file
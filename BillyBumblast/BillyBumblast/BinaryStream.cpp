@@ -0,0 +1,184 @@
+
+#include "BinaryStream.h"
+#include <istream>
+#include <ostream>
+
+
+serialise::Writer::Writer(u32 initial_size)
+	: failed(false)
+	, sink(0)
+	, flushed_size(0)
+{
+	begin = new char[initial_size];
+	pos = begin;
+	end = begin + initial_size;
+}
+
+
+serialise::Writer::Writer(OutputSink& sink, u32 buffer_size)
+	: failed(false)
+	, sink(&sink)
+	, flushed_size(0)
+{
+	begin = new char[buffer_size];
+	pos = begin;
+	end = begin + buffer_size;
+}
+
+
+serialise::Writer::~Writer()
+{
+	Flush();
+	delete [] begin;
+}
+
+
+bool serialise::Writer::Flush()
+{
+	if (sink == 0 || pos == begin)
+		return !failed;
+
+	u32 size = u32(pos - begin);
+	if (!failed && !sink->Write(begin, size))
+		failed = true;
+
+	flushed_size += size;
+	pos = begin;
+	return !failed;
+}
+
+
+void serialise::Writer::WriteOverflow(const void* data, u32 size)
+{
+	if (sink)
+	{
+		Flush();
+
+		// Anything too big for the buffer goes straight to the sink instead of in pieces
+		if (size >= u32(end - begin))
+		{
+			if (!failed && !sink->Write(data, size))
+				failed = true;
+			flushed_size += size;
+			return;
+		}
+	}
+
+	else
+	{
+		// Grow the buffer by at least doubling it so that lots of small writes copy little
+		u32 used = u32(pos - begin);
+		u32 capacity = u32(end - begin) * 2;
+		if (capacity < used + size)
+			capacity = used + size;
+
+		char* new_begin = new char[capacity];
+		memcpy(new_begin, begin, used);
+		delete [] begin;
+
+		begin = new_begin;
+		pos = begin + used;
+		end = begin + capacity;
+	}
+
+	memcpy(pos, data, size);
+	pos += size;
+}
+
+
+serialise::Reader::Reader(const void* data, u32 size)
+	: failed(false)
+	, begin((const char*)data)
+	, pos((const char*)data)
+	, end((const char*)data + size)
+	, buffer(0)
+	, buffer_size(0)
+	, source(0)
+{
+}
+
+
+serialise::Reader::Reader(InputSource& source, u32 buffer_size)
+	: failed(false)
+	, buffer(new char[buffer_size])
+	, buffer_size(buffer_size)
+	, source(&source)
+{
+	// Empty until the first read
+	begin = buffer;
+	pos = buffer;
+	end = buffer;
+}
+
+
+serialise::Reader::~Reader()
+{
+	delete [] buffer;
+}
+
+
+void serialise::Reader::ReadOverflow(void* data, u32 size)
+{
+	// Take whatever is left in the buffer first
+	u32 available = u32(end - pos);
+	memcpy(data, pos, available);
+	pos = end;
+
+	char* dst = (char*)data + available;
+	u32 remaining = size - available;
+
+	if (source && !failed)
+	{
+		if (remaining >= buffer_size)
+		{
+			// Large reads go straight into the destination
+			u32 nb_read = source->Read(dst, remaining);
+			dst += nb_read;
+			remaining -= nb_read;
+		}
+		else
+		{
+			u32 nb_read = source->Read(buffer, buffer_size);
+			pos = buffer;
+			end = buffer + nb_read;
+
+			u32 nb_copied = nb_read < remaining ? nb_read : remaining;
+			memcpy(dst, pos, nb_copied);
+			pos += nb_copied;
+			dst += nb_copied;
+			remaining -= nb_copied;
+		}
+	}
+
+	if (remaining)
+	{
+		memset(dst, 0, remaining);
+		failed = true;
+	}
+}
+
+
+bool serialise::FileSink::Write(const void* data, u32 size)
+{
+	return fwrite(data, 1, size, fp) == size;
+}
+
+
+u32 serialise::FileSource::Read(void* data, u32 size)
+{
+	return (u32)fread(data, 1, size, fp);
+}
+
+
+bool serialise::StreamSink::Write(const void* data, u32 size)
+{
+	ostream.write((const char*)data, size);
+	return !ostream.fail();
+}
+
+
+u32 serialise::StreamSource::Read(void* data, u32 size)
+{
+	istream.read((char*)data, size);
+	return (u32)istream.gcount();
+}
@@ -0,0 +1,239 @@
+
+#pragma once
+
+
+#include "Core.h"
+#include <cstdio>
+#include <cstring>
+#include <iosfwd>
+
+
+namespace serialise
+{
+	struct JitCompiler;
+
+
+	//
+	// Destination for the buffered data of a writer, written to in large blocks
+	//
+	struct OutputSink
+	{
+		virtual ~OutputSink()
+		{
+		}
+
+		// Returns false if not all of the data could be written
+		virtual bool Write(const void* data, u32 size) = 0;
+	};
+
+
+	//
+	// Source of data for a reader, read from in large blocks
+	//
+	struct InputSource
+	{
+		virtual ~InputSource()
+		{
+		}
+
+		// Returns the number of bytes read, which is less than requested at the end of the data
+		virtual u32 Read(void* data, u32 size) = 0;
+	};
+
+
+	//
+	// Appends binary data to a memory buffer. Without a sink the buffer grows to hold everything
+	// written to it, otherwise it's flushed to the sink whenever it fills up.
+	//
+	struct Writer
+	{
+		enum { DEFAULT_BUFFER_SIZE = 64 * 1024 };
+
+		Writer(u32 initial_size = 256);
+		Writer(OutputSink& sink, u32 buffer_size = DEFAULT_BUFFER_SIZE);
+
+		// Flushes anything left to the sink
+		~Writer();
+
+		void Write(const void* data, u32 size)
+		{
+			if (size <= u32(end - pos))
+			{
+				memcpy(pos, data, size);
+				pos += size;
+			}
+			else
+			{
+				WriteOverflow(data, size);
+			}
+		}
+
+		template <typename TYPE> void Write(const TYPE& value)
+		{
+			Write(&value, sizeof(value));
+		}
+
+		// Hand everything buffered to the sink, returning false if the sink has failed
+		bool Flush();
+
+		// Total number of bytes written, including those already flushed
+		u64 GetSize() const
+		{
+			return flushed_size + (pos - begin);
+		}
+
+		// Everything written so far, only valid for writers without a sink
+		const char* GetData() const
+		{
+			return begin;
+		}
+
+		// Set once the sink fails to write, after which writes are discarded
+		bool failed;
+
+	private:
+		// Compiled serialisers inline the fast path of Write
+		friend struct JitCompiler;
+
+		Writer(const Writer&);
+		Writer& operator = (const Writer&);
+
+		void WriteOverflow(const void* data, u32 size);
+
+		char* begin;
+		char* pos;
+		char* end;
+
+		OutputSink* sink;
+		u64 flushed_size;
+	};
+
+
+	//
+	// Reads binary data from memory, either directly from the caller's memory or from a buffer that's
+	// refilled from a source
+	//
+	struct Reader
+	{
+		enum { DEFAULT_BUFFER_SIZE = 64 * 1024 };
+
+		// The data isn't copied so must outlive the reader
+		Reader(const void* data, u32 size);
+		Reader(InputSource& source, u32 buffer_size = DEFAULT_BUFFER_SIZE);
+
+		~Reader();
+
+		void Read(void* data, u32 size)
+		{
+			if (size <= u32(end - pos))
+			{
+				memcpy(data, pos, size);
+				pos += size;
+			}
+			else
+			{
+				ReadOverflow(data, size);
+			}
+		}
+
+		template <typename TYPE> TYPE Read()
+		{
+			TYPE value;
+			Read(&value, sizeof(value));
+			return value;
+		}
+
+		// Skip over the next size bytes, returning where they are in the caller's memory so that they
+		// can be used without copying. Returns null, without skipping, for readers with a source or
+		// when there isn't enough data left. There's no alignment beyond that of the data written.
+		const void* ReadView(u32 size)
+		{
+			if (source || size > u32(end - pos))
+				return 0;
+			const char* data = pos;
+			pos += size;
+			return data;
+		}
+
+		// Is the pointer into the memory the reader was created on?
+		bool Contains(const void* ptr) const
+		{
+			return source == 0 && ptr >= begin && ptr < end;
+		}
+
+		// Set once a read goes past the end of the data, with the missing bytes read as zero
+		bool failed;
+
+	private:
+		// Compiled deserialisers inline the fast path of Read
+		friend struct JitCompiler;
+
+		Reader(const Reader&);
+		Reader& operator = (const Reader&);
+
+		void ReadOverflow(void* data, u32 size);
+
+		const char* begin;
+		const char* pos;
+		const char* end;
+
+		// Only allocated when reading from a source
+		char* buffer;
+		u32 buffer_size;
+		InputSource* source;
+	};
+
+
+	//
+	// Adapters for writing to and reading from files opened by the caller
+	//
+	struct FileSink : public OutputSink
+	{
+		FileSink(FILE* fp) : fp(fp)
+		{
+		}
+
+		bool Write(const void* data, u32 size);
+
+		FILE* fp;
+	};
+
+
+	struct FileSource : public InputSource
+	{
+		FileSource(FILE* fp) : fp(fp)
+		{
+		}
+
+		u32 Read(void* data, u32 size);
+
+		FILE* fp;
+	};
+
+
+	//
+	// Adapters for code that already works with standard streams
+	//
+	struct StreamSink : public OutputSink
+	{
+		StreamSink(std::ostream& ostream) : ostream(ostream)
+		{
+		}
+
+		bool Write(const void* data, u32 size);
+
+		std::ostream& ostream;
+	};
+
+
+	struct StreamSource : public InputSource
+	{
+		StreamSource(std::istream& istream) : istream(istream)
+		{
+		}
+
+		u32 Read(void* data, u32 size);
+
+		std::istream& istream;
+	};
+}
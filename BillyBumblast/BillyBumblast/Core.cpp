@@ -1,9 +1,100 @@
 
 #include "Core.h"
 #include "MurmurHash2.h"
+#include <cstdlib>
+#include <cstring>
 
 
-Name::Name(const char* name) : string(name)
+namespace
 {
+	const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+}
+
+
+void* Arena::Alloc(size_t size, size_t align)
+{
+	// Align the current position, starting a new block if there's not enough space left
+	size_t padding = (align - (size_t)pos % align) % align;
+	if (pos == 0 || size + padding > size_t(end - pos))
+	{
+		// Blocks are enlarged to fit allocations bigger than the default block size
+		size_t header_size = (sizeof(Block) + 15) & ~size_t(15);
+		size_t block_size = size + align > ARENA_BLOCK_SIZE ? size + align : ARENA_BLOCK_SIZE;
+		Block* block = (Block*)malloc(header_size + block_size);
+		block->next = blocks;
+		blocks = block;
+
+		pos = (char*)block + header_size;
+		end = pos + block_size;
+		padding = (align - (size_t)pos % align) % align;
+	}
+
+	void* data = pos + padding;
+	pos += padding + size;
+
+	nb_allocations++;
+	allocated_bytes += size;
+	return data;
+}
+
+
+const char* Arena::AllocString(const char* str, size_t length)
+{
+	char* copy = (char*)Alloc(length + 1, 1);
+	memcpy(copy, str, length);
+	copy[length] = 0;
+	return copy;
+}
+
+
+void Arena::Adopt(Arena& other)
+{
+	if (other.blocks == 0)
+		return;
+
+	// Link the other arena's blocks in behind the current one, which is still being allocated from
+	Block* last = other.blocks;
+	while (last->next)
+		last = last->next;
+	if (blocks)
+	{
+		last->next = blocks->next;
+		blocks->next = other.blocks;
+	}
+	else
+	{
+		blocks = other.blocks;
+	}
+
+	nb_allocations += other.nb_allocations;
+	allocated_bytes += other.allocated_bytes;
+
+	other.blocks = 0;
+	other.pos = 0;
+	other.end = 0;
+	other.nb_allocations = 0;
+	other.allocated_bytes = 0;
+}
+
+
+void Arena::Reset()
+{
+	while (blocks)
+	{
+		Block* next = blocks->next;
+		free(blocks);
+		blocks = next;
+	}
+
+	pos = 0;
+	end = 0;
+}
+
+
+Name::Name(const char* name)
+{
+#if RFL_NAME_STRINGS
+	string = name;
+#endif
 	hash_id = MurmurHash2(name, (int)strlen(name), 0xFEEDB00D);
-}
\ No newline at end of file
+}
@@ -2,23 +2,139 @@
 #pragma once
 
 #include <string>
+#include <new>
 
 
+typedef unsigned char u8;
 typedef unsigned int u32;
 typedef unsigned __int64 u64;
 
 
+//
+// Bump allocator that carves objects out of large blocks, all of which are released in one go
+// Destructors are never called so only objects that own no other memory should be allocated here
+//
+struct Arena
+{
+	Arena() : blocks(0), pos(0), end(0), nb_allocations(0), allocated_bytes(0)
+	{
+	}
+
+	~Arena()
+	{
+		Reset();
+	}
+
+	void* Alloc(size_t size, size_t align);
+
+	// Copy a string, keeping its null terminator
+	const char* AllocString(const char* str, size_t length);
+
+	// Default construct an array of objects
+	template <typename TYPE> TYPE* New(u32 count)
+	{
+		if (count == 0)
+			return 0;
+
+		TYPE* objects = (TYPE*)Alloc(sizeof(TYPE) * count, __alignof(TYPE));
+		for (u32 i = 0; i < count; i++)
+			new (objects + i) TYPE;
+		return objects;
+	}
+
+	// Take ownership of all blocks allocated by another arena, leaving it empty
+	void Adopt(Arena& other);
+
+	// Free every block, invalidating all allocations
+	void Reset();
+
+	// Each block starts with a pointer to the previously allocated block
+	struct Block
+	{
+		Block* next;
+	};
+
+	Block* blocks;
+
+	// Remaining space in the most recent block
+	char* pos;
+	char* end;
+
+	// Running totals of calls to Alloc and the bytes they requested
+	u32 nb_allocations;
+	u64 allocated_bytes;
+};
+
+
+//
+// Fixed-size array of objects that are allocated from an arena and never resized once loaded
+//
+template <typename TYPE> struct Array
+{
+	Array() : data(0), count(0)
+	{
+	}
+
+	void Allocate(Arena& arena, u32 nb_items)
+	{
+		data = arena.New<TYPE>(nb_items);
+		count = nb_items;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	bool empty() const
+	{
+		return count == 0;
+	}
+
+	TYPE& operator [] (size_t index)
+	{
+		return data[index];
+	}
+
+	const TYPE& operator [] (size_t index) const
+	{
+		return data[index];
+	}
+
+	TYPE* data;
+	u32 count;
+};
+
+
+//
+// Names only carry their string when RFL_NAME_STRINGS is set, which it is by default in debug builds.
+// Otherwise a name is just its hash, with strings looked up in the debug string pool of the module
+// that loaded it, if that was loaded at all.
+//
+#ifndef RFL_NAME_STRINGS
+#ifdef _DEBUG
+#define RFL_NAME_STRINGS 1
+#else
+#define RFL_NAME_STRINGS 0
+#endif
+#endif
+
+
 struct Name
 {
 	Name() : hash_id(0)
 	{
+#if RFL_NAME_STRINGS
+		string = 0;
+#endif
 	}
 
 	Name(const char* name);
 
-	// TODO: Remove from runtime
-	std::string string;
+#if RFL_NAME_STRINGS
+	// Null if the name has no string, otherwise owned by whatever created the name (e.g. a module's arena)
+	const char* string;
+#endif
 
 	u32 hash_id;
 };
-
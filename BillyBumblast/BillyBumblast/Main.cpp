@@ -1,19 +1,19 @@
  
 #include "Rfl.h"
 #include "RflXmlDbReader.h"
+#include "RflBinDbReader.h"
+#include "RflModuleRegistry.h"
 #include "Win32.h"
 #include "BinarySerialiser.h"
+#include "BinaryJit.h"
 #include "STLVector.h"
 #include "STLString.h"
 
-#include <sstream>
-
 
 // TODO:
 // * Attributes need to be proven
 // * Serialisation of pointers to objects
 // * Iterators
-// * Inheritance hierarchy
 // * Endian-ness swap when the generating machine differs from the loading machine
 // * Smart pointers
 // * Overloaded methods (e.g. constructors)
@@ -21,9 +21,10 @@
 // * Look at the inheritance tree - does everything really need to inherit from Scope?
 // * Casting types to their most derived needs to be a simple, clear operation
 // * Function calling API with varying calling conventions (http://msdn.microsoft.com/en-us/library/k2b2ssfy(VS.71).aspx)
-// * Handle multiple DLLs (e.g. for the case of mult-threaded debug dll crt libs)
 //
 // DONE:
+// * Inheritance hierarchy, with constant-time IsA tests
+// * Handle multiple DLLs (e.g. for the case of mult-threaded debug dll crt libs)
 // * Native C++ arrays
 // * Create objects by type name
 // * Template-based collections
@@ -140,15 +141,19 @@ int Win32::Main(int argc, const char** argv)
 	PODTest p;
 	p.Func();
 
-	rfl::Module* module = rfl::XmlDbReader::LoadModule("BillyBumblast.xml");
+	// Plugin DLLs would be loaded through the same registry using Win32::GetModuleBaseAddress
+	rfl::ModuleRegistry registry;
+	registry.LoadModule(
+		"BillyBumblast.xml", "BillyBumblast.rflbin", Win32::GetProgramBaseAddress(),
+		rfl::XmlDbReader::LOAD_PARALLEL | rfl::BinDbReader::LOAD_LAZY);
+
 	rfl::Type* string_type = rfl::TypeOf<std::string>();
 	rfl::TemplateInstance* vectype0 = static_cast<rfl::TemplateInstance*>(rfl::TypeOf< std::vector<int> >());
 	rfl::Type* vectype1 = vectype0->instance_of;
 
-	string_type->serialise_func = SerialiseSTLString;
-	string_type->deserialise_func = DeserialiseSTLString;
-	vectype1->serialise_func = STLVector::Serialise;
-	vectype1->deserialise_func = STLVector::Deserialise;
+	string_type->SetSerialiseFuncs(SerialiseSTLString, DeserialiseSTLString);
+	vectype1->SetSerialiseFuncs(STLVector::Serialise, STLVector::Deserialise);
+	vectype1->SetViewFuncs(STLVector::DeserialiseView, STLVector::ReleaseView);
 
 	Configuration config;
 	config.resolution.x = 640;
@@ -170,11 +175,30 @@ int Win32::Main(int argc, const char** argv)
 	config.looking_place[0] = "high";
 	config.looking_place[1] = "low";
 
-	std::stringstream s;
-	serialise::BinarySerialise(config, s);
+	serialise::Writer writer;
+	serialise::BinarySerialise(config, writer);
 
 	Configuration configb;
-	serialise::BinaryDeserialise(configb, s);
+	serialise::Reader reader(writer.GetData(), (u32)writer.GetSize());
+	serialise::BinaryDeserialise(configb, reader);
+
+	// Read-only copy with vectors of ints that point into the serialised data
+	Configuration configc;
+	serialise::Reader view_reader(writer.GetData(), (u32)writer.GetSize());
+	serialise::BinaryDeserialiseView(configc, view_reader);
+	serialise::BinaryReleaseView(configc, view_reader);
+
+	// Same again with code compiled for the class, which writes the same bytes
+	serialise::JitCache jit_cache;
+	rfl::Type* config_type = rfl::TypeOf<Configuration>();
+	jit_cache.Compile(rfl::ExactCast<rfl::Class>(config_type));
+
+	serialise::Writer jit_writer;
+	serialise::BinarySerialiseObject((const char*)&config, config_type, jit_writer);
+
+	Configuration configd;
+	serialise::Reader jit_reader(jit_writer.GetData(), (u32)jit_writer.GetSize());
+	serialise::BinaryDeserialiseObject((char*)&configd, config_type, jit_reader);
 
 	return 0;
 }
@@ -3,22 +3,361 @@
 #include "Win32.h"
 #include "tinyxml.h"
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 using namespace rfl;
 
 
+namespace
+{
+	bool EntryLess(const NameIndex::Entry& a, const NameIndex::Entry& b)
+	{
+		// Objects with the same name stay in collection order
+		return a.hash_id < b.hash_id || (a.hash_id == b.hash_id && a.index < b.index);
+	}
+
+
+	bool EntryHashLess(const NameIndex::Entry& entry, u32 hash_id)
+	{
+		return entry.hash_id < hash_id;
+	}
+
+
+	template <typename TYPE> const TYPE* FindByName(const Array<TYPE>& collection, const NameIndex& index, u32 hash_id)
+	{
+		int i = index.Find(hash_id);
+		return i < 0 ? 0 : &collection[i];
+	}
+
+
+	template <typename FUNC> void ForEachType(Scope& scope, FUNC& func);
+
+
+	template <typename TYPE, typename FUNC> void ForEachTypeIn(Array<TYPE>& types, FUNC& func)
+	{
+		for (u32 i = 0; i < types.count; i++)
+		{
+			func(types[i]);
+			ForEachType(types[i], func);
+		}
+	}
+
+
+	// Call the function for every type nested inside the scope
+	template <typename FUNC> void ForEachType(Scope& scope, FUNC& func)
+	{
+		if (scope.children == 0)
+			return;
+
+		ScopeChildren& children = *scope.children;
+		for (u32 i = 0; i < children.namespaces.count; i++)
+			ForEachType(children.namespaces[i], func);
+		ForEachTypeIn(children.base_types, func);
+		ForEachTypeIn(children.classes, func);
+		ForEachTypeIn(children.templates, func);
+		ForEachTypeIn(children.template_instances, func);
+		ForEachTypeIn(children.enums, func);
+	}
+
+
+	void ResetTraits(Type& type)
+	{
+		type.traits &= ~Type::TRAIT_BUILT;
+		if (type.kind == Type::KIND_CLASS)
+			static_cast<Class&>(type).serialise_plan.version = 0;
+	}
+
+
+	void BuildTraits(Type& type)
+	{
+		type.BuildTraits();
+	}
+
+
+	struct BuildSerialisePlan
+	{
+		BuildSerialisePlan(Arena& arena) : arena(arena)
+		{
+		}
+
+		void operator () (Type& type)
+		{
+			if (type.kind != Type::KIND_CLASS || type.lazy_loader)
+				return;
+
+			// Classes in both the scope tree and the type index only need building once
+			Class& cls = static_cast<Class&>(type);
+			if (!cls.serialise_plan.IsCurrent())
+				cls.BuildSerialisePlan(arena);
+		}
+
+		Arena& arena;
+	};
+
+
+	// Incremented whenever plans that have already been built may be out of date
+	u32 g_SerialisePlanVersion = 1;
+
+
+	// Set as the hierarchy of classes while their base classes are being built, so that cycles in
+	// corrupt databases are cut instead of recursing forever
+	TypeHierarchy g_HierarchyInProgress;
+
+
+	void AddCopyOp(std::vector<SerialisePlan::Op>& ops, u32 offset, u32 size)
+	{
+		// Extend the previous copy if this one follows straight on from it
+		if (!ops.empty())
+		{
+			SerialisePlan::Op& last = ops.back();
+			if (last.code == SerialisePlan::OP_COPY && last.offset + last.size == offset)
+			{
+				last.size += size;
+				return;
+			}
+		}
+
+		SerialisePlan::Op op = { SerialisePlan::OP_COPY, offset, size, 0 };
+		ops.push_back(op);
+	}
+
+
+	void AddObjectOp(std::vector<SerialisePlan::Op>& ops, u32 code, u32 offset, u32 size, const Type* type)
+	{
+		SerialisePlan::Op op = { code, offset, size, type };
+		ops.push_back(op);
+	}
+
+
+	// Add the ops that serialise each field of the class, in the same way and in the same order as
+	// serialising the fields one at a time would
+	void FlattenFields(const Class& cls, u32 base_offset, std::vector<SerialisePlan::Op>& ops, std::vector<const Type*>& raw_types)
+	{
+		const FieldTable& fields = cls.field_table;
+		for (u32 i = 0; i < fields.count; i++)
+		{
+			const Type* field_type = fields.types[i];
+			if (field_type == 0)
+				continue;
+			field_type->Materialise();
+
+			u32 offset = base_offset + fields.offsets[i];
+
+			// Arrays of objects that don't need constructing are always copied as raw bytes
+			if (fields.flags[i] & FieldTable::FLAG_ARRAY)
+			{
+				if (field_type->traits & Type::TRAIT_NEEDS_CONSTRUCT)
+					AddObjectOp(ops, SerialisePlan::OP_OBJECT_ARRAY, offset, fields.element_counts[i], field_type);
+				else
+					AddCopyOp(ops, offset, fields.element_counts[i] * field_type->size);
+				continue;
+			}
+
+			if (field_type->traits & Type::TRAIT_CUSTOM_SERIALISER)
+			{
+				AddObjectOp(ops, SerialisePlan::OP_OBJECT, offset, 1, field_type);
+				continue;
+			}
+
+			switch (field_type->kind)
+			{
+			case Type::KIND_BASE_TYPE:
+			case Type::KIND_ENUM:
+				AddCopyOp(ops, offset, field_type->size);
+				raw_types.push_back(field_type);
+				break;
+
+			case Type::KIND_CLASS:
+				// Deep POD classes are made of nothing but copies so can be merged with their neighbours
+				if (field_type->traits & Type::TRAIT_DEEP_POD)
+				{
+					FlattenFields(static_cast<const Class&>(*field_type), offset, ops, raw_types);
+					raw_types.push_back(field_type);
+				}
+				else
+					AddObjectOp(ops, SerialisePlan::OP_OBJECT, offset, 1, field_type);
+				break;
+
+			case Type::KIND_TEMPLATE_INSTANCE:
+				AddObjectOp(ops, SerialisePlan::OP_OBJECT, offset, 1, field_type);
+				break;
+
+			default:
+				// Templates have nothing to serialise without custom serialise functions
+				break;
+			}
+		}
+	}
+
+
+	// Finalisation mix from MurmurHash3, spreading a seeded hash ID over all of its bits
+	u32 MixHash(u32 h)
+	{
+		h ^= h >> 16;
+		h *= 0x85EBCA6B;
+		h ^= h >> 13;
+		h *= 0xC2B2AE35;
+		h ^= h >> 16;
+		return h;
+	}
+
+
+	// Map a well distributed value into [0, range) with a multiply instead of a divide
+	u32 ScaleHash(u32 h, u32 range)
+	{
+		return (u32)(((u64)h * range) >> 32);
+	}
+
+
+	u32 GetPerfectHashSlot(u32 hash_id, u32 seed, u32 nb_slots)
+	{
+		return ScaleHash(MixHash(hash_id ^ (seed * 0x9E3779B9)), nb_slots);
+	}
+
+
+	// Give up on seed searches that run this long, which only happens with duplicate hash IDs
+	const u32 MAX_PERFECT_HASH_SEED = 1 << 24;
+
+
+	template <typename TYPE> void BuildCollectionIndexes(Arena& arena, const Array<TYPE>& collection)
+	{
+		// The objects are never moved so can be modified through the collection
+		for (u32 i = 0; i < collection.count; i++)
+			collection.data[i].BuildNameIndexes(arena);
+	}
+}
+
+
+void Type::Materialise() const
+{
+	// The loader clears the lazy state once it's done
+	if (lazy_loader)
+	{
+		Type& type = const_cast<Type&>(*this);
+		lazy_loader->MaterialiseType(type);
+		type.BuildTraits();
+	}
+}
+
+
+void Type::BuildTraits()
+{
+	if ((traits & TRAIT_BUILT) || lazy_loader)
+		return;
+
+	u8 new_traits = TRAIT_TRIVIALLY_COPYABLE | TRAIT_DEEP_POD;
+	if (constructor)
+		new_traits |= TRAIT_NEEDS_CONSTRUCT;
+	if (destructor)
+		new_traits |= TRAIT_NEEDS_DESTRUCT;
+	if (constructor || destructor || copy_constructor || assignment_operator)
+		new_traits &= ~TRAIT_TRIVIALLY_COPYABLE;
+
+	switch (kind)
+	{
+	case KIND_CLASS:
+	{
+		const Class& cls = static_cast<const Class&>(*this);
+		if (!cls.is_pod)
+			new_traits &= ~TRAIT_DEEP_POD;
+
+		for (u32 i = 0; i < cls.field_table.count; i++)
+		{
+			// Pointers are copied by value but can't be serialised as raw bytes
+			if (cls.field_table.flags[i] & (FieldTable::FLAG_POINTER | FieldTable::FLAG_REFERENCE))
+			{
+				new_traits &= ~TRAIT_DEEP_POD;
+				continue;
+			}
+
+			// Types can't contain themselves by value so this can't recurse forever
+			const Type* field_type = cls.field_table.types[i];
+			if (field_type == 0)
+			{
+				new_traits &= ~(TRAIT_TRIVIALLY_COPYABLE | TRAIT_DEEP_POD);
+				continue;
+			}
+			field_type->Materialise();
+			const_cast<Type*>(field_type)->BuildTraits();
+			new_traits &= field_type->traits | ~(TRAIT_TRIVIALLY_COPYABLE | TRAIT_DEEP_POD);
+		}
+		break;
+	}
+
+	case KIND_TEMPLATE:
+	case KIND_TEMPLATE_INSTANCE:
+		// Nothing is known about the layout of template instances
+		new_traits &= ~TRAIT_DEEP_POD;
+		break;
+
+	default:
+		break;
+	}
+
+	traits = (traits & TRAIT_CUSTOM_SERIALISER) | new_traits | TRAIT_BUILT;
+}
+
+
+void Type::SetSerialiseFuncs(
+	void (*serialise)(const Type* type, const void* object, serialise::Writer& writer),
+	void (*deserialise)(const Type* type, void* object, serialise::Reader& reader))
+{
+	// Plans may have copied objects of the type instead of calling its serialise functions
+	Materialise();
+	if ((traits & TRAIT_DEEP_POD) || !(traits & TRAIT_BUILT))
+		g_SerialisePlanVersion++;
+
+	serialise_func = serialise;
+	deserialise_func = deserialise;
+	if (serialise && deserialise)
+		traits |= TRAIT_CUSTOM_SERIALISER;
+	else
+		traits &= ~TRAIT_CUSTOM_SERIALISER;
+}
+
+
+void Type::SetViewFuncs(
+	void (*deserialise_view)(const Type* type, void* object, serialise::Reader& reader),
+	void (*release_view)(const Type* type, void* object, const serialise::Reader& reader))
+{
+	deserialise_view_func = deserialise_view;
+	release_view_func = release_view;
+}
+
+
 void* Type::CreateObject() const
 {
+	Materialise();
 	char* data = new char[size];
-	if (constructor)
+	if (traits & TRAIT_NEEDS_CONSTRUCT)
 		constructor->Call(data);
 	return data;
 }
 
 
+bool Type::CopyObject(void* dst, const void* src) const
+{
+	Materialise();
+	if (traits & TRAIT_TRIVIALLY_COPYABLE)
+	{
+		memcpy(dst, src, size);
+		return true;
+	}
+
+	if (assignment_operator)
+	{
+		assignment_operator->Call(dst, src);
+		return true;
+	}
+
+	return false;
+}
+
+
 void Function::Call() const
 {
-	u64 base_address = Win32::GetProgramBaseAddress();
+	u64 base_address = module ? module->base_address : Win32::GetProgramBaseAddress();
 	u32 faddress = u32(base_address + call_address);
 	__asm call faddress
 }
@@ -27,16 +366,811 @@ void Function::Call() const
 void Function::Call(void* object) const
 {
 	// thiscall assumed
-	u64 base_address = Win32::GetProgramBaseAddress();
+	u64 base_address = module ? module->base_address : Win32::GetProgramBaseAddress();
+	u32 faddress = u32(base_address + call_address);
+	__asm
+	{
+		mov ecx, object
+		call faddress
+	}
+}
+
+
+void Function::Call(void* object, const void* arg) const
+{
+	// thiscall assumed, with the callee popping the argument
+	u64 base_address = module ? module->base_address : Win32::GetProgramBaseAddress();
 	u32 faddress = u32(base_address + call_address);
 	__asm
 	{
+		push arg
 		mov ecx, object
 		call faddress
 	}
 }
 
 
+const ScopeChildren ScopeChildren::empty;
+
+
+ScopeChildren& Scope::AllocChildren(Arena& arena)
+{
+	if (children == 0)
+		children = arena.New<ScopeChildren>(1);
+	return *children;
+}
+
+
+void NameIndex::Sort()
+{
+	std::sort(entries.data, entries.data + entries.count, EntryLess);
+}
+
+
+int NameIndex::Find(u32 hash_id) const
+{
+	const Entry* begin = entries.data;
+	const Entry* end = begin + entries.count;
+	const Entry* entry = std::lower_bound(begin, end, hash_id, EntryHashLess);
+	if (entry == end || entry->hash_id != hash_id)
+		return -1;
+	return entry->index;
+}
+
+
+const Namespace* Scope::FindNamespace(u32 hash_id) const
+{
+	return FindByName(GetChildren().namespaces, GetChildren().namespace_index, hash_id);
+}
+
+
+const BaseType* Scope::FindBaseType(u32 hash_id) const
+{
+	return FindByName(GetChildren().base_types, GetChildren().base_type_index, hash_id);
+}
+
+
+const Class* Scope::FindClass(u32 hash_id) const
+{
+	return FindByName(GetChildren().classes, GetChildren().class_index, hash_id);
+}
+
+
+const Template* Scope::FindTemplate(u32 hash_id) const
+{
+	return FindByName(GetChildren().templates, GetChildren().template_index, hash_id);
+}
+
+
+const TemplateInstance* Scope::FindTemplateInstance(u32 hash_id) const
+{
+	return FindByName(GetChildren().template_instances, GetChildren().template_instance_index, hash_id);
+}
+
+
+const Enum* Scope::FindEnum(u32 hash_id) const
+{
+	return FindByName(GetChildren().enums, GetChildren().enum_index, hash_id);
+}
+
+
+const Function* Scope::FindFunction(u32 hash_id) const
+{
+	return FindByName(GetChildren().functions, GetChildren().function_index, hash_id);
+}
+
+
+void Scope::BuildNameIndexes(Arena& arena)
+{
+	if (children == 0)
+		return;
+
+	ScopeChildren& c = *children;
+	c.namespace_index.Build(arena, c.namespaces);
+	c.base_type_index.Build(arena, c.base_types);
+	c.class_index.Build(arena, c.classes);
+	c.template_index.Build(arena, c.templates);
+	c.template_instance_index.Build(arena, c.template_instances);
+	c.enum_index.Build(arena, c.enums);
+	c.function_index.Build(arena, c.functions);
+
+	BuildCollectionIndexes(arena, c.namespaces);
+	BuildCollectionIndexes(arena, c.base_types);
+	BuildCollectionIndexes(arena, c.classes);
+	BuildCollectionIndexes(arena, c.templates);
+	BuildCollectionIndexes(arena, c.template_instances);
+	BuildCollectionIndexes(arena, c.enums);
+}
+
+
+void Class::BuildNameIndexes(Arena& arena)
+{
+	Scope::BuildNameIndexes(arena);
+	field_index.Build(arena, fields);
+}
+
+
+const Field* Class::FindField(u32 hash_id) const
+{
+	Materialise();
+	return FindByName(fields, field_index, hash_id);
+}
+
+
+void Enum::BuildNameIndexes(Arena& arena)
+{
+	Scope::BuildNameIndexes(arena);
+	entry_index.Build(arena, entries);
+}
+
+
+const Enum::Entry* Enum::FindEntry(u32 hash_id) const
+{
+	Materialise();
+	return FindByName(entries, entry_index, hash_id);
+}
+
+
+bool TypeHierarchy::ContainsSecondaryBase(const Type* type) const
+{
+	return std::binary_search(secondary_bases.data, secondary_bases.data + secondary_bases.count, type);
+}
+
+
+void Class::BuildHierarchy(Arena& arena)
+{
+	if (hierarchy || base_classes.empty())
+		return;
+	hierarchy = &g_HierarchyInProgress;
+
+	// Only classes can be derived from, and they share this class's meta type
+	const Type* primary_base = 0;
+	std::vector<const Type*> secondary_bases;
+	for (u32 i = 0; i < base_classes.count; i++)
+	{
+		const Type* base = base_classes[i].type;
+		if (base == 0 || base->type != type)
+			continue;
+
+		// Base classes from other modules were built when their module was loaded. Those still being
+		// built are derived from this class, which isn't valid, so are skipped.
+		const_cast<Class*>(static_cast<const Class*>(base))->BuildHierarchy(arena);
+		const TypeHierarchy* base_hierarchy = base->hierarchy;
+		if (base_hierarchy == &g_HierarchyInProgress)
+			continue;
+
+		if (primary_base == 0)
+		{
+			primary_base = base;
+		}
+		else
+		{
+			secondary_bases.push_back(base);
+			if (base_hierarchy)
+				secondary_bases.insert(secondary_bases.end(), base_hierarchy->display.data, base_hierarchy->display.data + base_hierarchy->display.count);
+		}
+
+		if (base_hierarchy)
+			secondary_bases.insert(secondary_bases.end(), base_hierarchy->secondary_bases.data, base_hierarchy->secondary_bases.data + base_hierarchy->secondary_bases.count);
+	}
+
+	if (primary_base == 0)
+	{
+		hierarchy = 0;
+		return;
+	}
+
+	// Extend the primary base's display with the primary base itself
+	TypeHierarchy* new_hierarchy = arena.New<TypeHierarchy>(1);
+	const TypeHierarchy* primary_hierarchy = primary_base->hierarchy;
+	u32 depth = primary_hierarchy ? primary_hierarchy->display.count : 0;
+	new_hierarchy->display.Allocate(arena, depth + 1);
+	for (u32 i = 0; i < depth; i++)
+		new_hierarchy->display[i] = primary_hierarchy->display[i];
+	new_hierarchy->display[depth] = primary_base;
+
+	// Ancestors found through the display don't need to be searched for
+	std::sort(secondary_bases.begin(), secondary_bases.end());
+	secondary_bases.erase(std::unique(secondary_bases.begin(), secondary_bases.end()), secondary_bases.end());
+	u32 nb_secondary_bases = 0;
+	for (size_t i = 0; i < secondary_bases.size(); i++)
+	{
+		if (std::find(new_hierarchy->display.data, new_hierarchy->display.data + depth + 1, secondary_bases[i]) == new_hierarchy->display.data + depth + 1)
+			secondary_bases[nb_secondary_bases++] = secondary_bases[i];
+	}
+	new_hierarchy->secondary_bases.Allocate(arena, nb_secondary_bases);
+	for (u32 i = 0; i < nb_secondary_bases; i++)
+		new_hierarchy->secondary_bases[i] = secondary_bases[i];
+
+	hierarchy = new_hierarchy;
+}
+
+
+void Class::BuildFieldTable(Arena& arena)
+{
+	FieldTable& table = field_table;
+	table.count = fields.count;
+	if (table.count == 0)
+	{
+		table = FieldTable();
+		return;
+	}
+
+	// Allocate all arrays as one block, in order of decreasing alignment
+	size_t types_size = table.count * sizeof(const Type*);
+	size_t u32_size = table.count * sizeof(u32);
+	char* data = (char*)arena.Alloc(types_size + u32_size * 2 + table.count, __alignof(const Type*));
+	table.types = (const Type**)data;
+	table.offsets = (u32*)(data + types_size);
+	table.element_counts = (u32*)(data + types_size + u32_size);
+	table.flags = (u8*)(data + types_size + u32_size * 2);
+
+	for (u32 i = 0; i < table.count; i++)
+	{
+		const Field& field = fields[i];
+		table.types[i] = field.type;
+		table.offsets[i] = field.offset;
+		table.element_counts[i] = field.array_rank ? field.array_length_0 * field.array_length_1 : 1;
+
+		u8 flags = 0;
+		if (field.array_rank)
+			flags |= FieldTable::FLAG_ARRAY;
+		if (field.modifier == Parameter::POINTER)
+			flags |= FieldTable::FLAG_POINTER;
+		if (field.modifier == Parameter::REFERENCE)
+			flags |= FieldTable::FLAG_REFERENCE;
+		if (field.is_const)
+			flags |= FieldTable::FLAG_CONST;
+		table.flags[i] = flags;
+	}
+}
+
+
+void Class::BuildSerialisePlan(Arena& arena)
+{
+	BuildTraits();
+
+	std::vector<SerialisePlan::Op> ops;
+	std::vector<const Type*> raw_types;
+	FlattenFields(*this, 0, ops, raw_types);
+
+	serialise_plan.ops.Allocate(arena, (u32)ops.size());
+	for (u32 i = 0; i < serialise_plan.ops.count; i++)
+		serialise_plan.ops[i] = ops[i];
+
+	std::sort(raw_types.begin(), raw_types.end());
+	raw_types.erase(std::unique(raw_types.begin(), raw_types.end()), raw_types.end());
+	serialise_plan.raw_types.Allocate(arena, (u32)raw_types.size());
+	for (u32 i = 0; i < serialise_plan.raw_types.count; i++)
+		serialise_plan.raw_types[i] = raw_types[i];
+
+	serialise_plan.version = g_SerialisePlanVersion;
+}
+
+
+bool SerialisePlan::IsCurrent() const
+{
+	if (version == g_SerialisePlanVersion)
+		return true;
+	if (version == 0)
+		return false;
+
+	// Serialise functions have been set on some type since the plan was last checked, which only
+	// matters if it's one the plan copies as raw bytes
+	for (u32 i = 0; i < raw_types.count; i++)
+	{
+		if (raw_types[i]->traits & Type::TRAIT_CUSTOM_SERIALISER)
+			return false;
+	}
+
+	// Every thread checking writes the same value so there's no harm in racing
+	const_cast<SerialisePlan*>(this)->version = g_SerialisePlanVersion;
+	return true;
+}
+
+
+void TypeIndex::Reserve(u32 nb_types)
+{
+	// Keep the load factor at 50% or below so that probe sequences stay short
+	u32 capacity = 16;
+	while (capacity < nb_types * 2)
+		capacity *= 2;
+	if (capacity <= entries.size())
+		return;
+
+	// Re-insert existing entries into the larger table
+	std::vector<Entry> old_entries;
+	old_entries.swap(entries);
+	Entry empty = { 0, 0 };
+	entries.resize(capacity, empty);
+	count = 0;
+
+	for (size_t i = 0; i < old_entries.size(); i++)
+	{
+		if (old_entries[i].type)
+			Add(old_entries[i].hash_id, old_entries[i].type);
+	}
+}
+
+
+void TypeIndex::Add(u32 hash_id, Type* type)
+{
+	// Null types mark unused entries so can't be stored
+	if (type == 0)
+		return;
+
+	if ((count + 1) * 2 > entries.size())
+		Reserve(count + 1);
+
+	// Hash IDs are already well distributed so their low bits are used directly, with linear probing
+	u32 mask = (u32)entries.size() - 1;
+	for (u32 i = hash_id & mask; ; i = (i + 1) & mask)
+	{
+		Entry& entry = entries[i];
+		if (entry.type == 0)
+		{
+			entry.hash_id = hash_id;
+			entry.type = type;
+			count++;
+			return;
+		}
+
+		if (entry.hash_id == hash_id)
+		{
+			entry.type = type;
+			return;
+		}
+	}
+}
+
+
+Type* TypeIndex::Find(u32 hash_id) const
+{
+	if (entries.empty())
+		return 0;
+
+	u32 mask = (u32)entries.size() - 1;
+	for (u32 i = hash_id & mask; ; i = (i + 1) & mask)
+	{
+		const Entry& entry = entries[i];
+		if (entry.type == 0)
+			return 0;
+		if (entry.hash_id == hash_id)
+			return entry.type;
+	}
+}
+
+
+u32 TypePerfectHash::GetNbBuckets(u32 nb_types)
+{
+	// An average of 4 hash IDs per bucket keeps the seeds small while the search stays fast
+	return nb_types / 4 + 1;
+}
+
+
+bool TypePerfectHash::FindSeeds(const std::vector<u32>& hash_ids, std::vector<u32>& seeds)
+{
+	u32 nb_slots = (u32)hash_ids.size();
+	u32 nb_buckets = GetNbBuckets(nb_slots);
+	seeds.assign(nb_buckets, 0);
+
+	// Sort the hash IDs by bucket, using the high bits of the hash so the slot search can use the rest
+	std::vector<u32> bucket_starts(nb_buckets + 1, 0);
+	for (u32 i = 0; i < nb_slots; i++)
+		bucket_starts[ScaleHash(hash_ids[i], nb_buckets) + 1]++;
+	u32 max_bucket_size = 0;
+	for (u32 i = 0; i < nb_buckets; i++)
+	{
+		max_bucket_size = std::max(max_bucket_size, bucket_starts[i + 1]);
+		bucket_starts[i + 1] += bucket_starts[i];
+	}
+
+	std::vector<u32> bucket_hash_ids(nb_slots);
+	std::vector<u32> bucket_ends(bucket_starts.begin(), bucket_starts.end() - 1);
+	for (u32 i = 0; i < nb_slots; i++)
+		bucket_hash_ids[bucket_ends[ScaleHash(hash_ids[i], nb_buckets)]++] = hash_ids[i];
+
+	// Place the largest buckets first, while most slots are free
+	std::vector<u32> size_starts(max_bucket_size + 2, 0);
+	for (u32 i = 0; i < nb_buckets; i++)
+		size_starts[max_bucket_size - (bucket_starts[i + 1] - bucket_starts[i]) + 1]++;
+	for (u32 i = 0; i <= max_bucket_size; i++)
+		size_starts[i + 1] += size_starts[i];
+	std::vector<u32> bucket_order(nb_buckets);
+	for (u32 i = 0; i < nb_buckets; i++)
+		bucket_order[size_starts[max_bucket_size - (bucket_starts[i + 1] - bucket_starts[i])]++] = i;
+
+	std::vector<char> taken(nb_slots, 0);
+	std::vector<u32> bucket_slots(max_bucket_size);
+	for (u32 i = 0; i < nb_buckets; i++)
+	{
+		u32 bucket = bucket_order[i];
+		const u32* bucket_ids = bucket_hash_ids.empty() ? 0 : &bucket_hash_ids[bucket_starts[bucket]];
+		u32 bucket_size = bucket_starts[bucket + 1] - bucket_starts[bucket];
+		if (bucket_size == 0)
+			break;
+
+		for (u32 seed = 0; ; seed++)
+		{
+			if (seed == MAX_PERFECT_HASH_SEED)
+				return false;
+
+			u32 j = 0;
+			for ( ; j < bucket_size; j++)
+			{
+				u32 slot = GetPerfectHashSlot(bucket_ids[j], seed, nb_slots);
+				if (taken[slot])
+					break;
+				taken[slot] = 1;
+				bucket_slots[j] = slot;
+			}
+
+			if (j == bucket_size)
+			{
+				seeds[bucket] = seed;
+				break;
+			}
+
+			// Release the slots taken by this attempt before trying the next seed
+			while (j--)
+				taken[bucket_slots[j]] = 0;
+		}
+	}
+
+	return true;
+}
+
+
+bool TypePerfectHash::Build(Arena& arena, const TypeIndex& types)
+{
+	std::vector<u32> hash_ids;
+	hash_ids.reserve(types.count);
+	for (size_t i = 0; i < types.entries.size(); i++)
+	{
+		if (types.entries[i].type)
+			hash_ids.push_back(types.entries[i].hash_id);
+	}
+
+	std::vector<u32> found_seeds;
+	if (!FindSeeds(hash_ids, found_seeds))
+	{
+		Clear();
+		return false;
+	}
+
+	return Place(arena, types, &found_seeds[0], (u32)found_seeds.size());
+}
+
+
+bool TypePerfectHash::Place(Arena& arena, const TypeIndex& types, const u32* src_seeds, u32 nb_seeds)
+{
+	Clear();
+	if (types.count == 0 || nb_seeds != GetNbBuckets(types.count))
+		return false;
+
+	seeds.Allocate(arena, nb_seeds);
+	memcpy(seeds.data, src_seeds, nb_seeds * sizeof(u32));
+
+	slots.Allocate(arena, types.count);
+	memset(slots.data, 0, types.count * sizeof(TypeIndex::Entry));
+
+	for (size_t i = 0; i < types.entries.size(); i++)
+	{
+		const TypeIndex::Entry& entry = types.entries[i];
+		if (entry.type == 0)
+			continue;
+
+		// Seeds for a different set of types will eventually put two types in the same slot
+		u32 seed = seeds[ScaleHash(entry.hash_id, nb_seeds)];
+		TypeIndex::Entry& slot = slots[GetPerfectHashSlot(entry.hash_id, seed, slots.count)];
+		if (slot.type)
+		{
+			Clear();
+			return false;
+		}
+		slot = entry;
+	}
+
+	return true;
+}
+
+
+void TypePerfectHash::Clear()
+{
+	// Any memory is left in the arena
+	seeds = Array<u32>();
+	slots = Array<TypeIndex::Entry>();
+}
+
+
+Type* TypePerfectHash::Find(u32 hash_id) const
+{
+	if (slots.count == 0)
+		return 0;
+
+	// Hash IDs that aren't in the set still land on a slot so its occupant has to be checked
+	u32 seed = seeds[ScaleHash(hash_id, seeds.count)];
+	const TypeIndex::Entry& slot = slots[GetPerfectHashSlot(hash_id, seed, slots.count)];
+	return slot.hash_id == hash_id ? slot.type : 0;
+}
+
+
+void NamePool::Reserve(u32 nb_strings)
+{
+	// Keep the load factor at 50% or below so that probe sequences stay short
+	u32 capacity = 16;
+	while (capacity < nb_strings * 2)
+		capacity *= 2;
+	if (capacity <= entries.size())
+		return;
+
+	// Re-insert existing entries into the larger table
+	std::vector<Entry> old_entries;
+	old_entries.swap(entries);
+	Entry empty = { 0, 0 };
+	entries.resize(capacity, empty);
+	count = 0;
+
+	for (size_t i = 0; i < old_entries.size(); i++)
+	{
+		if (old_entries[i].string)
+			Add(old_entries[i].hash_id, old_entries[i].string);
+	}
+}
+
+
+void NamePool::Add(u32 hash_id, const char* string)
+{
+	// Null strings mark unused entries so can't be stored
+	if (string == 0)
+		return;
+
+	if ((count + 1) * 2 > entries.size())
+		Reserve(count + 1);
+
+	u32 mask = (u32)entries.size() - 1;
+	for (u32 i = hash_id & mask; ; i = (i + 1) & mask)
+	{
+		Entry& entry = entries[i];
+		if (entry.string == 0)
+		{
+			entry.hash_id = hash_id;
+			entry.string = string;
+			count++;
+			return;
+		}
+
+		if (entry.hash_id == hash_id)
+			return;
+	}
+}
+
+
+const char* NamePool::Find(u32 hash_id) const
+{
+	if (entries.empty())
+		return 0;
+
+	u32 mask = (u32)entries.size() - 1;
+	for (u32 i = hash_id & mask; ; i = (i + 1) & mask)
+	{
+		const Entry& entry = entries[i];
+		if (entry.string == 0)
+			return 0;
+		if (entry.hash_id == hash_id)
+			return entry.string;
+	}
+}
+
+
+Type* Module::ResolveType(Type* type) const
+{
+	if (type && shared_types)
+	{
+		if (Type* shared_type = shared_types->Find(type->full_name.hash_id))
+			return shared_type;
+	}
+
+	return type;
+}
+
+
+Type* Module::FindType(u32 hash_id) const
+{
+	Type* type = type_hash.slots.empty() ? types.Find(hash_id) : type_hash.Find(hash_id);
+	if (type)
+		type->Materialise();
+	return type;
+}
+
+
+Type* Module::FindType(const char* full_name) const
+{
+	return FindType(Name(full_name).hash_id);
+}
+
+
+const char* Module::GetString(const Name& name) const
+{
+	return names.Find(name.hash_id);
+}
+
+
+void Module::BuildTypeTraits()
+{
+	// Types with duplicate names are only in the scope tree and types added by a reload are only
+	// in the type index, so both are walked. Types can contain each other by value so all are reset
+	// before any are built.
+	ForEachType(global_namespace, ResetTraits);
+	for (size_t i = 0; i < types.entries.size(); i++)
+	{
+		if (Type* type = types.entries[i].type)
+			ResetTraits(*type);
+	}
+
+	ForEachType(global_namespace, BuildTraits);
+	for (size_t i = 0; i < types.entries.size(); i++)
+	{
+		if (Type* type = types.entries[i].type)
+			type->BuildTraits();
+	}
+
+	// Plans depend on the traits of the field types so are built once all traits are
+	BuildSerialisePlan build_serialise_plan(arena);
+	ForEachType(global_namespace, build_serialise_plan);
+	for (size_t i = 0; i < types.entries.size(); i++)
+	{
+		if (Type* type = types.entries[i].type)
+			build_serialise_plan(*type);
+	}
+}
+
+
+void ModuleBinding::Bind(Module& module) const
+{
+	module.base_address = base_address ? base_address : Win32::GetProgramBaseAddress();
+	module.shared_types = shared_types;
+}
+
+
+void rfl::UnloadModule(Module* module)
+{
+	if (module == 0)
+		return;
+
+	u64 base_address = module->base_address;
+
+	for (size_t i = 0; i < module->types.entries.size(); i++)
+	{
+		// Reset any TypeOf pointers that were patched by the loader so that they don't dangle
+		Type* type = module->types.entries[i].type;
+		if (type && type->typeof_va)
+		{
+			Type** type_ptr = (Type**)(type->typeof_va + base_address);
+			if (*type_ptr == type)
+				*type_ptr = 0;
+		}
+	}
+
+	// The arena goes with the module, freeing every object in one go
+	delete module;
+}
+
+
+void rfl::UpdateTypeOfPointers(const Module& module)
+{
+	u64 base_address = module.base_address;
+
+	for (size_t i = 0; i < module.types.entries.size(); i++)
+	{
+		Type* type = module.types.entries[i].type;
+		if (type && type->typeof_va)
+		{
+			Type** type_ptr = (Type**)(type->typeof_va + base_address);
+			*type_ptr = module.ResolveType(type);
+		}
+	}
+}
+
+
+namespace
+{
+	LoadStatsCallback load_stats_callback = 0;
+	void* load_stats_user_data = 0;
+
+
+	void CountScopeContents(const Scope& scope, LoadStats& stats);
+
+
+	template <typename TYPE> void CountCollectionContents(const Array<TYPE>& collection, LoadStats& stats)
+	{
+		for (size_t i = 0; i < collection.size(); i++)
+			CountScopeContents(collection[i], stats);
+	}
+
+
+	void CountScopeContents(const Scope& scope, LoadStats& stats)
+	{
+		stats.nb_functions += (u32)scope.functions().size();
+		for (size_t i = 0; i < scope.classes().size(); i++)
+			stats.nb_fields += (u32)scope.classes()[i].fields.size();
+
+		CountCollectionContents(scope.namespaces(), stats);
+		CountCollectionContents(scope.base_types(), stats);
+		CountCollectionContents(scope.classes(), stats);
+		CountCollectionContents(scope.templates(), stats);
+		CountCollectionContents(scope.template_instances(), stats);
+		CountCollectionContents(scope.enums(), stats);
+	}
+}
+
+
+LoadStats::LoadStats()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+
+const char* LoadStats::GetPhaseName(Phase phase)
+{
+	static const char* names[NB_PHASES] =
+	{
+		"MapFile",
+		"Scan",
+		"Build",
+		"PatchTypes",
+		"UpdateModulePointers",
+	};
+
+	return phase < NB_PHASES ? names[phase] : "Unknown";
+}
+
+
+void LoadStats::BeginLoad()
+{
+	load_start = Win32::GetTicks();
+	phase_start = load_start;
+}
+
+
+void LoadStats::EndPhase(Phase phase)
+{
+	u64 now = Win32::GetTicks();
+	phase_ms[phase] += Win32::TicksToMs(now - phase_start);
+	phase_start = now;
+}
+
+
+void LoadStats::EndLoad(const char* filename, const Module* module)
+{
+	total_ms = Win32::TicksToMs(Win32::GetTicks() - load_start);
+
+	if (module)
+	{
+		nb_allocations = module->arena.nb_allocations;
+		allocated_bytes = module->arena.allocated_bytes;
+
+		nb_types = module->types.count;
+		nb_fields = 0;
+		nb_functions = 0;
+		CountScopeContents(module->global_namespace, *this);
+
+		if (!module->types.entries.empty())
+			type_index_load_factor = (float)module->types.count / module->types.entries.size();
+	}
+
+	if (load_stats_callback)
+		load_stats_callback(filename, *this, load_stats_user_data);
+}
+
+
+void rfl::SetLoadStatsCallback(LoadStatsCallback callback, void* user_data)
+{
+	load_stats_callback = callback;
+	load_stats_user_data = user_data;
+}
+
+
 // Reflect all native C++ types
 RFL_REFLECT_TYPE(void);
 RFL_REFLECT_TYPE(bool);
@@ -6,6 +6,13 @@
 #include "Core.h"
 
 
+namespace serialise
+{
+	struct Writer;
+	struct Reader;
+}
+
+
 namespace rfl
 {
 	struct Namespace;
@@ -17,6 +24,9 @@ namespace rfl
 	struct Enum;
 	struct Function;
 	struct Field;
+	struct LazyLoader;
+	struct Module;
+	struct TypeHierarchy;
 
 
 	//
@@ -35,12 +45,79 @@ namespace rfl
 	};
 
 
+	//
+	// Lookup of the objects in a collection by the hash of their name, sorted by hash for binary search
+	//
+	struct NameIndex
+	{
+		struct Entry
+		{
+			u32 hash_id;
+			u32 index;
+		};
+
+		// Does nothing if the collection has already been indexed
+		template <typename TYPE> void Build(Arena& arena, const Array<TYPE>& collection)
+		{
+			if (entries.count == collection.count)
+				return;
+
+			entries.Allocate(arena, collection.count);
+			for (u32 i = 0; i < collection.count; i++)
+			{
+				entries[i].hash_id = collection[i].name.hash_id;
+				entries[i].index = i;
+			}
+			Sort();
+		}
+
+		// Position in the collection of the first object with the name, or -1 if there isn't one
+		int Find(u32 hash_id) const;
+
+		void Sort();
+
+		Array<Entry> entries;
+	};
+
+
+	//
+	// Symbols nested inside a scope, allocated from the module's arena only for scopes that have any
+	//
+	struct ScopeChildren
+	{
+		Array<Namespace> namespaces;
+
+		Array<BaseType> base_types;
+
+		Array<Class> classes;
+
+		Array<Template> templates;
+
+		Array<TemplateInstance> template_instances;
+
+		Array<Enum> enums;
+
+		Array<Function> functions;
+
+		NameIndex namespace_index;
+		NameIndex base_type_index;
+		NameIndex class_index;
+		NameIndex template_index;
+		NameIndex template_instance_index;
+		NameIndex enum_index;
+		NameIndex function_index;
+
+		// Returned for scopes without children
+		static const ScopeChildren empty;
+	};
+
+
 	//
 	// A collection of symbols that can be nested
 	//
 	struct Scope : public Object
 	{
-		Scope() : parent_scope(0)
+		Scope() : parent_scope(0), children(0)
 		{
 		}
 
@@ -50,19 +127,65 @@ namespace rfl
 		// up type names
 		Name full_name;
 
-		std::vector<Namespace> namespaces;
+		// Most types have no children, so they only pay for the pointer
+		ScopeChildren* children;
+
+		// Get the children for adding to, allocating them on first use
+		ScopeChildren& AllocChildren(Arena& arena);
+
+		const ScopeChildren& GetChildren() const
+		{
+			return children ? *children : ScopeChildren::empty;
+		}
+
+		const Array<Namespace>& namespaces() const
+		{
+			return GetChildren().namespaces;
+		}
 
-		std::vector<BaseType> base_types;
+		const Array<BaseType>& base_types() const
+		{
+			return GetChildren().base_types;
+		}
+
+		const Array<Class>& classes() const
+		{
+			return GetChildren().classes;
+		}
 
-		std::vector<Class> classes;
+		const Array<Template>& templates() const
+		{
+			return GetChildren().templates;
+		}
 
-		std::vector<Template> templates;
+		const Array<TemplateInstance>& template_instances() const
+		{
+			return GetChildren().template_instances;
+		}
 
-		std::vector<TemplateInstance> template_instances;
+		const Array<Enum>& enums() const
+		{
+			return GetChildren().enums;
+		}
 
-		std::vector<Enum> enums;
+		const Array<Function>& functions() const
+		{
+			return GetChildren().functions;
+		}
 
-		std::vector<Function> functions;
+		// Find children by the hash of their name, rather than their full name, returning null if
+		// there are none. Overloaded functions share a name so the first is returned. The functions
+		// of lazily loaded types are only there once the type has been materialised.
+		const Namespace* FindNamespace(u32 hash_id) const;
+		const BaseType* FindBaseType(u32 hash_id) const;
+		const Class* FindClass(u32 hash_id) const;
+		const Template* FindTemplate(u32 hash_id) const;
+		const TemplateInstance* FindTemplateInstance(u32 hash_id) const;
+		const Enum* FindEnum(u32 hash_id) const;
+		const Function* FindFunction(u32 hash_id) const;
+
+		// Index the names of everything in the scope and all scopes nested inside it
+		void BuildNameIndexes(Arena& arena);
 	};
 
 
@@ -76,7 +199,53 @@ namespace rfl
 	//
 	struct Type : public Scope
 	{
-		Type() : unique_id(0), size(0), typeof_va(0), serialise_func(0), deserialise_func(0)
+		// Which of the type structs derived from Type this is, so that code handling all types can
+		// switch on it instead of comparing meta types
+		enum Kind
+		{
+			KIND_BASE_TYPE,
+			KIND_CLASS,
+			KIND_TEMPLATE,
+			KIND_TEMPLATE_INSTANCE,
+			KIND_ENUM,
+			NB_KINDS
+		};
+
+		// Properties of the type's objects, worked out when the type is fully loaded
+		enum Traits
+		{
+			// Objects can be copied with memcpy as there's no constructor, destructor, copy constructor
+			// or assignment operator anywhere in their value fields
+			TRAIT_TRIVIALLY_COPYABLE = 1,
+
+			// The type has its own serialise functions
+			TRAIT_CUSTOM_SERIALISER = 2,
+
+			TRAIT_NEEDS_CONSTRUCT = 4,
+			TRAIT_NEEDS_DESTRUCT = 8,
+
+			// Plain data all the way down, with no pointers or references in any field, so that objects
+			// can be serialised as raw bytes
+			TRAIT_DEEP_POD = 16,
+
+			// Set once the other traits have been built
+			TRAIT_BUILT = 128,
+		};
+
+		// Loaders only create the derived types, which pass their own kind
+		Type(Kind kind = KIND_BASE_TYPE)
+			: unique_id(0)
+			, size(0)
+			, typeof_va(0)
+			, kind(kind)
+			, traits(0)
+			, serialise_func(0)
+			, deserialise_func(0)
+			, deserialise_view_func(0)
+			, release_view_func(0)
+			, hierarchy(0)
+			, lazy_loader(0)
+			, lazy_index(0)
 		{
 			// Again, more horrid code: This is because of the pointer patching stuff which needs to be fixed
 			// Setting to -1 forces the patching to set these to null post-load
@@ -92,28 +261,195 @@ namespace rfl
 
 		u32 typeof_va;
 
+		// Kind and Traits values, stored as bytes
+		u8 kind;
+		u8 traits;
+
 		const Function* constructor;
 		const Function* destructor;
 		const Function* copy_constructor;
 		const Function* assignment_operator;
 
-		void (*serialise_func)(const Type* type, const void* object, std::ostream& ostream);
-		void (*deserialise_func)(const Type* type, void* object, std::istream& istream);
+		// Set with SetSerialiseFuncs so that the type's traits are kept up to date
+		void (*serialise_func)(const Type* type, const void* object, serialise::Writer& writer);
+		void (*deserialise_func)(const Type* type, void* object, serialise::Reader& reader);
+
+		// Optional read-only deserialisation that leaves objects referencing the reader's memory, and
+		// the function that detaches them from it again before they're destroyed
+		void (*deserialise_view_func)(const Type* type, void* object, serialise::Reader& reader);
+		void (*release_view_func)(const Type* type, void* object, const serialise::Reader& reader);
+
+		// Only set for classes with base classes
+		const TypeHierarchy* hierarchy;
+
+		// Set while the type's functions, fields and enum entries have yet to be loaded, with the
+		// index the loader needs to find them
+		LazyLoader* lazy_loader;
+		u32 lazy_index;
+
+		// Ensure the full contents of the type are loaded. This isn't thread-safe for lazily loaded types.
+		void Materialise() const;
+
+		// Work out the type's traits from its functions and fields, building them for the types of
+		// its fields first. Lazily loaded types get their traits built when they're materialised.
+		void BuildTraits();
+
+		// Replace the type's custom serialise functions, which are used in place of the default
+		// serialisation for its kind when both are set. Serialise plans go stale if the type was
+		// being copied as raw bytes.
+		void SetSerialiseFuncs(
+			void (*serialise)(const Type* type, const void* object, serialise::Writer& writer),
+			void (*deserialise)(const Type* type, void* object, serialise::Reader& reader));
+
+		// Set the functions used in place of the deserialise function by view deserialisation, which
+		// falls back to the deserialise function for types without them
+		void SetViewFuncs(
+			void (*deserialise_view)(const Type* type, void* object, serialise::Reader& reader),
+			void (*release_view)(const Type* type, void* object, const serialise::Reader& reader));
 
 		void* CreateObject() const;
 
+		// Copy an object of this type over another, returning false if the type can't be copied
+		bool CopyObject(void* dst, const void* src) const;
+
 		template <typename TYPE> TYPE* CreateObject() const
 		{
 			return (TYPE*)CreateObject();
 		}
+
+		// Is this the given type or a class derived from it? The type can't be null.
+		bool IsA(const Type* type) const;
+
+		// Excludes the type itself
+		bool DerivedFrom(const Type* type) const;
 	};
 
 
+	//
+	// Where a class sits in the inheritance hierarchy, worked out at load so that subtype tests are a
+	// couple of compares. Following the first base class of each class gives a tree, and a class's
+	// chain of ancestors along it is stored as a Cohen display: an array indexed by depth in the tree,
+	// where depth is the number of ancestors. Classes only reachable through later base classes are
+	// kept in a separate sorted list, which is empty unless multiple inheritance is used.
+	//
+	struct TypeHierarchy
+	{
+		// Is the type an ancestor of the class?
+		bool Contains(const Type* type) const
+		{
+			// Classes without base classes are at the root of the tree
+			u32 depth = type->hierarchy ? type->hierarchy->display.count : 0;
+			if (depth < display.count && display[depth] == type)
+				return true;
+			return !secondary_bases.empty() && ContainsSecondaryBase(type);
+		}
+
+		bool ContainsSecondaryBase(const Type* type) const;
+
+		// Ancestors along the first base class chain, from the root down to the direct base
+		Array<const Type*> display;
+
+		// All other ancestors, sorted by address
+		Array<const Type*> secondary_bases;
+	};
+
+
+	inline bool Type::IsA(const Type* type) const
+	{
+		return this == type || (hierarchy && hierarchy->Contains(type));
+	}
+
+
+	inline bool Type::DerivedFrom(const Type* type) const
+	{
+		return this != type && hierarchy && hierarchy->Contains(type);
+	}
+
+
 	//
 	// A native C++ type
 	//
 	struct BaseType : public Type
 	{
+		BaseType() : Type(KIND_BASE_TYPE)
+		{
+		}
+	};
+
+
+	//
+	// Structure-of-arrays copy of the parts of a class's fields that are needed to walk its objects,
+	// with an entry in each array for every field, in declaration order. Field names and the rest of
+	// the field descriptions are left in Class::fields.
+	//
+	struct FieldTable
+	{
+		enum Flags
+		{
+			FLAG_ARRAY = 1,
+			FLAG_POINTER = 2,
+			FLAG_REFERENCE = 4,
+			FLAG_CONST = 8,
+		};
+
+		FieldTable() : count(0), types(0), offsets(0), element_counts(0), flags(0)
+		{
+		}
+
+		u32 count;
+
+		const Type** types;
+		u32* offsets;
+
+		// Number of elements in array fields, or 1 for everything else
+		u32* element_counts;
+
+		u8* flags;
+	};
+
+
+	//
+	// Flattened list of the steps needed to serialise a class's objects, so that serialisers don't have
+	// to walk the fields of every object. Fields that are written as raw bytes, including those of nested
+	// deep POD classes, are merged into as few copies as possible. Everything else is left to the
+	// serialiser as objects of their own.
+	//
+	struct SerialisePlan
+	{
+		enum OpCode
+		{
+			// Copy size bytes at offset
+			OP_COPY,
+
+			// Serialise the object of the given type at offset
+			OP_OBJECT,
+
+			// Serialise size objects of the given type, packed together from offset
+			OP_OBJECT_ARRAY,
+		};
+
+		struct Op
+		{
+			u32 code;
+			u32 offset;
+			u32 size;
+			const Type* type;
+		};
+
+		SerialisePlan() : version(0)
+		{
+		}
+
+		// Plans go stale when serialise functions are set on a type they copy as raw bytes, after which
+		// they're ignored until Module::BuildTypeTraits is called again. Plans that don't copy the type
+		// are checked again and stay current.
+		bool IsCurrent() const;
+
+		u32 version;
+		Array<Op> ops;
+
+		// Every type whose objects are copied as raw bytes by the copy ops, other than array elements
+		Array<const Type*> raw_types;
 	};
 
 
@@ -122,23 +458,67 @@ namespace rfl
 	//
 	struct Class : public Type
 	{
-		Class() : is_pod(false)
+		struct BaseClass
+		{
+			BaseClass() : type(0), offset(0)
+			{
+			}
+
+			const Type* type;
+
+			// Offset of the base class within objects of this class
+			u32 offset;
+		};
+
+		Class() : Type(KIND_CLASS), is_pod(false)
 		{
 		}
 
+		// Build the class's hierarchy from its base classes, which must have their types resolved.
+		// Base classes from the same module have their hierarchy built first.
+		void BuildHierarchy(Arena& arena);
+
+		// Rebuild the field table from the fields, which must have their types resolved
+		void BuildFieldTable(Arena& arena);
+
+		// Index the names of the class's fields as well as its children
+		void BuildNameIndexes(Arena& arena);
+
+		// Rebuild the serialise plan from the field table, building the traits of the field types first
+		void BuildSerialisePlan(Arena& arena);
+
+		// Returns null if there's no field with the name
+		const Field* FindField(u32 hash_id) const;
+
 		bool is_pod;
 
-		std::vector<Field> fields;
+		// In declaration order, with the first one being the primary base class. Always loaded, even
+		// for lazily loaded classes.
+		Array<BaseClass> base_classes;
+
+		Array<Field> fields;
+		NameIndex field_index;
+
+		// Only valid once the class is fully loaded
+		FieldTable field_table;
+		SerialisePlan serialise_plan;
 	};
 
 
 	struct Template : public Type
 	{
+		Template() : Type(KIND_TEMPLATE)
+		{
+		}
 	};
 
 
 	struct TemplateInstance : public Type
 	{
+		TemplateInstance() : Type(KIND_TEMPLATE_INSTANCE), instance_of(0), type0(0), type1(0)
+		{
+		}
+
 		Template* instance_of;
 
 		const Type* type0;
@@ -151,6 +531,10 @@ namespace rfl
 	//
 	struct Enum : public Type
 	{
+		Enum() : Type(KIND_ENUM)
+		{
+		}
+
 		// A name/value pair for each enum entry
 		struct Entry
 		{
@@ -158,7 +542,14 @@ namespace rfl
 			int value;
 		};
 
-		std::vector<Entry> entries;
+		// Index the names of the enum's entries as well as its children
+		void BuildNameIndexes(Arena& arena);
+
+		// Returns null if there's no entry with the name
+		const Entry* FindEntry(u32 hash_id) const;
+
+		Array<Entry> entries;
+		NameIndex entry_index;
 	};
 
 
@@ -205,29 +596,286 @@ namespace rfl
 
 	struct Function
 	{
-		Function() : call_address(0)
+		Function() : call_address(0), module(0)
 		{
 		}
 
 		Name name;
 
+		// Relative to the base address of the module's binary
 		u32 call_address;
+		const Module* module;
 
 		Parameter return_parameter;
 
-		std::vector<Parameter> parameters;
+		Array<Parameter> parameters;
 
 		void Call() const;
 		void Call(void* object) const;
+		void Call(void* object, const void* arg) const;
+	};
+
+
+	//
+	// Flat, open-addressed hash table of types, keyed by their full name hash ID
+	//
+	struct TypeIndex
+	{
+		struct Entry
+		{
+			u32 hash_id;
+			Type* type;
+		};
+
+		TypeIndex() : count(0)
+		{
+		}
+
+		// Ensure the given number of types can be added without the table growing
+		void Reserve(u32 nb_types);
+
+		// Adding a type with a hash ID that's already in the table replaces the existing entry
+		void Add(u32 hash_id, Type* type);
+
+		Type* Find(u32 hash_id) const;
+
+		// Power-of-two sized with unused entries marked by a null type
+		std::vector<Entry> entries;
+
+		u32 count;
+	};
+
+
+	//
+	// Minimal perfect hash over the full name hash IDs of a module's types, built once they're all
+	// known. Hash IDs are split into buckets and each bucket has a seed that sends its hash IDs to
+	// slots of their own, so there's exactly one slot per type and a lookup is a single probe.
+	//
+	struct TypePerfectHash
+	{
+		// Search for a seed per bucket that places every hash ID in a different slot, returning
+		// false if there isn't one. Hash IDs must be unique.
+		static bool FindSeeds(const std::vector<u32>& hash_ids, std::vector<u32>& seeds);
+
+		// Number of seeds needed for a set of types
+		static u32 GetNbBuckets(u32 nb_types);
+
+		// Find seeds for the types in the index and place them, leaving the hash empty on failure
+		bool Build(Arena& arena, const TypeIndex& types);
+
+		// Place the types in the index with seeds found earlier for the same set of hash IDs, such
+		// as those stored in a binary database. Leaves the hash empty if the seeds don't fit.
+		bool Place(Arena& arena, const TypeIndex& types, const u32* seeds, u32 nb_seeds);
+
+		void Clear();
+
+		Type* Find(u32 hash_id) const;
+
+		Array<u32> seeds;
+
+		// One per type, in slot order
+		Array<TypeIndex::Entry> slots;
+	};
+
+
+	//
+	// Flat, open-addressed hash table of name strings keyed by their hash ID, so that each unique string
+	// in a module is stored once and shared by every Name that uses it
+	//
+	struct NamePool
+	{
+		struct Entry
+		{
+			u32 hash_id;
+			const char* string;
+		};
+
+		NamePool() : count(0)
+		{
+		}
+
+		// Ensure the given number of strings can be added without the table growing
+		void Reserve(u32 nb_strings);
+
+		// Strings must outlive the pool and aren't copied. Adding a hash ID that's already in the
+		// pool leaves the existing string in place.
+		void Add(u32 hash_id, const char* string);
+
+		const char* Find(u32 hash_id) const;
+
+		// Power-of-two sized with unused entries marked by a null string
+		std::vector<Entry> entries;
+
+		u32 count;
+	};
+
+
+	//
+	// Implemented by loaders that build the contents of types the first time they're used
+	//
+	struct LazyLoader
+	{
+		virtual ~LazyLoader()
+		{
+		}
+
+		virtual void MaterialiseType(Type& type) = 0;
 	};
 
 
+	//
+	// All objects in a module are allocated from its arena, making unload a matter of freeing a few blocks
+	//
 	struct Module
 	{
+		Module() : base_address(0), shared_types(0), lazy_loader(0)
+		{
+		}
+
+		~Module()
+		{
+			delete lazy_loader;
+		}
+
 		Namespace global_namespace;
+
+		// Owns the memory of every scope, type, function and name string in the module
+		Arena arena;
+
+		// Every type in the module, populated by the loader
+		TypeIndex types;
+
+		// Read-only lookup of the same types used by FindType, built once loading is complete. It's
+		// empty if no perfect hash could be found, in which case the type index is used instead.
+		TypePerfectHash type_hash;
+
+		// Debug string pool with every name string in the module, allocated from the arena. Names only
+		// store their hash in release builds so this is the only place to find their strings, and it's
+		// left empty if the module is loaded with LOAD_NO_NAMES.
+		NamePool names;
+
+		// Where the binary described by the module is loaded, locating its TypeOf pointers and functions
+		u64 base_address;
+
+		// Types loaded by other modules, which take precedence over the module's own copies so that
+		// each type has one identity across all binaries
+		const TypeIndex* shared_types;
+
+		// Only set if the module was loaded lazily
+		LazyLoader* lazy_loader;
+
+		// Returns the type that references to the given type should use
+		Type* ResolveType(Type* type) const;
+
+		// Types returned from here are always fully loaded
+		Type* FindType(u32 hash_id) const;
+		Type* FindType(const char* full_name) const;
+
+		// Looks up the string for a name in the debug string pool, returning null if it's not there
+		const char* GetString(const Name& name) const;
+
+		// Build the traits and serialise plans of every type in the module that isn't waiting to be
+		// lazily loaded, once all type references have been resolved. Rebuilds any that have already
+		// been built.
+		void BuildTypeTraits();
+
+		// Update the module from a newly generated XML database. Types are matched by full name and
+		// updated in place so that existing Type pointers remain valid. New types can be found with
+		// FindType but aren't added to the collections of existing scopes, and removed types are kept.
+		bool Reload(const char* xml_file);
+	};
+
+
+	// Clears any TypeOf pointers into the module before releasing all of its memory
+	void UnloadModule(Module* module);
+
+	// Point the TypeOf pointers in the program at the module's types, for modules loaded with
+	// LOAD_NO_TYPEOF_PATCH. Each pointer is replaced with a single aligned write.
+	void UpdateTypeOfPointers(const Module& module);
+
+
+	//
+	// Describes the binary a module is being loaded for, defaulting to the main executable on its own
+	//
+	struct ModuleBinding
+	{
+		ModuleBinding() : base_address(0), shared_types(0)
+		{
+		}
+
+		u64 base_address;
+		const TypeIndex* shared_types;
+
+		// Set up a newly created module
+		void Bind(Module& module) const;
 	};
 
 
+	//
+	// Measurements taken by the loaders, filled in on request or whenever there's a stats callback
+	//
+	struct LoadStats
+	{
+		enum Phase
+		{
+			// Mapping the database file into memory
+			PHASE_MAP_FILE,
+
+			// Pre-pass over the database before any objects are created (counting or validation)
+			PHASE_SCAN,
+
+			// Creating the module's objects
+			PHASE_BUILD,
+
+			// Resolving type references and populating the type index
+			PHASE_PATCH_TYPES,
+
+			// Pointing TypeOf pointers in the program at the loaded types
+			PHASE_UPDATE_MODULE_POINTERS,
+
+			NB_PHASES
+		};
+
+		LoadStats();
+
+		static const char* GetPhaseName(Phase phase);
+
+		// Called by the loaders as they start and end each phase, in order
+		void BeginLoad();
+		void EndPhase(Phase phase);
+
+		// Gathers the module totals and passes the stats on to any callback
+		void EndLoad(const char* filename, const Module* module);
+
+		// Wall time spent in each phase
+		double phase_ms[NB_PHASES];
+		double total_ms;
+
+		// Size of the database file
+		u64 bytes_read;
+
+		// Allocations from the module's arena
+		u32 nb_allocations;
+		u64 allocated_bytes;
+
+		// Objects loaded, which excludes the contents of lazily loaded types
+		u32 nb_types;
+		u32 nb_fields;
+		u32 nb_functions;
+
+		// Fraction of the type index entries in use
+		float type_index_load_factor;
+
+		u64 load_start;
+		u64 phase_start;
+	};
+
+
+	// Called at the end of every load, e.g. to forward the stats to telemetry
+	typedef void (*LoadStatsCallback)(const char* filename, const LoadStats& stats, void* user_data);
+	void SetLoadStatsCallback(LoadStatsCallback callback, void* user_data);
+
+
 	struct TemplateArg
 	{
 	};
@@ -255,6 +903,19 @@ namespace rfl
 
 		return static_cast<TYPE_TO*>(object_ptr);
 	}
+
+
+	// Like ExactCast but also succeeds for objects of types derived from TYPE_TO
+	template <typename TYPE_TO, typename TYPE_FROM> TYPE_TO* DynamicCast(TYPE_FROM* object_ptr)
+	{
+		Object* base_ptr = static_cast<Object*>(object_ptr);
+
+		const Type* type_to = TypeOf<TYPE_TO>();
+		if (base_ptr->type == 0 || type_to == 0 || !base_ptr->type->IsA(type_to))
+			return 0;
+
+		return static_cast<TYPE_TO*>(object_ptr);
+	}
 }
 
 
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "Core.h"
+
+
+//
+// On-disk layout of a binary reflection database (.rflbin)
+//
+// The file is a header followed by flat arrays of fixed-size records. Records never store pointers:
+// references to other records are indices into those arrays and strings are byte offsets into a
+// single string table. This means the file can be memory-mapped and walked directly, with none of
+// the per-node text parsing the XML database requires.
+//
+namespace rfl
+{
+	const u32 BINDB_MAGIC = 0x42464C52;		// "RLFB" when viewed as little-endian bytes
+	const u32 BINDB_VERSION = 3;
+	const u32 BINDB_INVALID_INDEX = 0xFFFFFFFF;
+
+
+	// A contiguous run of records in one of the database arrays
+	struct BinDbRange
+	{
+		u32 first;
+		u32 count;
+	};
+
+
+	// Location of a record array within the file
+	struct BinDbSection
+	{
+		u32 offset;
+		u32 count;
+	};
+
+
+	struct BinDbName
+	{
+		u32 hash_id;
+
+		// Offset into the string table, or BINDB_INVALID_INDEX if the name has no string
+		u32 string_offset;
+	};
+
+
+	struct BinDbScope
+	{
+		BinDbName name;
+		BinDbName full_name;
+
+		// Index of the type describing this object (e.g. rfl::Class)
+		u32 meta_type;
+
+		// Child namespaces index the namespace array, functions index the function array and all
+		// other children index the type array
+		BinDbRange namespaces;
+		BinDbRange base_types;
+		BinDbRange classes;
+		BinDbRange templates;
+		BinDbRange template_instances;
+		BinDbRange enums;
+		BinDbRange functions;
+	};
+
+
+	struct BinDbType
+	{
+		BinDbScope scope;
+
+		u32 unique_id;
+		u32 size;
+		u32 typeof_va;
+
+		// Indices relative to the start of this type's function range
+		u32 constructor;
+		u32 destructor;
+		u32 copy_constructor;
+		u32 assignment_operator;
+
+		// Only used by classes
+		u32 is_pod;
+		BinDbRange base_classes;
+		BinDbRange fields;
+
+		// Only used by enums
+		BinDbRange entries;
+
+		// Only used by template instances
+		u32 instance_of;
+		u32 type0;
+		u32 type1;
+	};
+
+
+	struct BinDbParameter
+	{
+		BinDbName name;
+		u32 type;
+		u32 is_const;
+		u32 modifier;
+		u32 array_rank;
+		u32 array_length_0;
+		u32 array_length_1;
+	};
+
+
+	struct BinDbField
+	{
+		BinDbParameter parameter;
+		u32 offset;
+	};
+
+
+	struct BinDbBaseClass
+	{
+		u32 type;
+		u32 offset;
+	};
+
+
+	struct BinDbFunction
+	{
+		BinDbName name;
+		u32 call_address;
+		BinDbParameter return_parameter;
+		BinDbRange parameters;
+	};
+
+
+	struct BinDbEnumEntry
+	{
+		BinDbName name;
+		int value;
+	};
+
+
+	struct BinDbHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 file_size;
+
+		// The string table is a run of null-terminated strings, its count is in bytes
+		BinDbSection strings;
+
+		// The global namespace is always the first entry in the namespace array
+		BinDbSection namespaces;
+		BinDbSection types;
+		BinDbSection base_classes;
+		BinDbSection fields;
+		BinDbSection functions;
+		BinDbSection parameters;
+		BinDbSection enum_entries;
+
+		// Seeds of the module's type perfect hash, which is rebuilt on load if it's missing
+		BinDbSection type_hash_seeds;
+	};
+}
@@ -0,0 +1,642 @@
+#include "RflBinDbReader.h"
+#include "RflBinDb.h"
+#include "Rfl.h"
+#include "Win32.h"
+
+using namespace rfl;
+
+
+namespace
+{
+	// A type pointer that can't be resolved until every type in the database has been allocated
+	struct TypeFixup
+	{
+		const Type** type_ptr;
+		u32 type_index;
+	};
+
+
+	// Types with contents beyond their functions, recorded for lazily loaded types
+	enum TypeKind
+	{
+		KIND_OTHER,
+		KIND_CLASS,
+		KIND_ENUM,
+	};
+
+
+	struct BinDb
+	{
+		const BinDbHeader* header;
+		const char* strings;
+		const BinDbScope* namespaces;
+		const BinDbType* types;
+		const BinDbBaseClass* base_classes;
+		const BinDbField* fields;
+		const BinDbFunction* functions;
+		const BinDbParameter* parameters;
+		const BinDbEnumEntry* enum_entries;
+		const u32* type_hash_seeds;
+
+		// Module being loaded, which owns all created objects
+		const Module* module;
+		Arena* arena;
+		NamePool* names;
+		bool load_names;
+
+		// Maps each type record index to its loaded type object
+		std::vector<Type*> type_table;
+
+		std::vector<TypeFixup> fixups;
+
+		// Classes that need their field tables building once type references have been resolved
+		std::vector<Class*> classes;
+
+		// Classes with base classes, which need their hierarchy building once the whole file is read
+		std::vector<Class*> derived_classes;
+
+		// Set when type contents are left to be read on first use, with the kind of each type record
+		LazyLoader* lazy_loader;
+		std::vector<char> type_kinds;
+	};
+
+
+	//
+	// Keeps the database mapped after load so that types can be completed when they're first used
+	//
+	struct BinDbLazyLoader : public LazyLoader
+	{
+		BinDbLazyLoader(const char* data) : data(data)
+		{
+		}
+
+		~BinDbLazyLoader()
+		{
+			Win32::UnmapFile(data);
+		}
+
+		void MaterialiseType(Type& type);
+
+		const char* data;
+		BinDb db;
+	};
+
+
+	void ReadNamespace(BinDb& db, const BinDbScope& src, Namespace& ns, Scope* parent_scope);
+	void ReadBaseType(BinDb& db, const BinDbType& src, BaseType& type, Scope* parent_scope);
+	void ReadClass(BinDb& db, const BinDbType& src, Class& cls, Scope* parent_scope);
+	void ReadTemplate(BinDb& db, const BinDbType& src, Template& templ, Scope* parent_scope);
+	void ReadTemplateInstance(BinDb& db, const BinDbType& src, TemplateInstance& instance, Scope* parent_scope);
+	void ReadEnum(BinDb& db, const BinDbType& src, Enum& enm, Scope* parent_scope);
+	void ReadFunction(BinDb& db, const BinDbFunction& src, Function& function, Scope*);
+
+
+	template <typename TYPE> const TYPE* GetSection(const char* data, u32 file_size, const BinDbSection& section)
+	{
+		// Reject any sections that don't fit inside the file
+		if (section.offset > file_size || section.count > (file_size - section.offset) / sizeof(TYPE))
+			return 0;
+
+		return (const TYPE*)(data + section.offset);
+	}
+
+
+	bool OpenDb(BinDb& db, const char* data, u32 file_size)
+	{
+		if (file_size < sizeof(BinDbHeader))
+			return false;
+
+		// Files written on a machine with different endian-ness are rejected here
+		const BinDbHeader& header = *(const BinDbHeader*)data;
+		if (header.magic != BINDB_MAGIC || header.version != BINDB_VERSION || header.file_size != file_size)
+			return false;
+
+		db.header = &header;
+		db.strings = GetSection<char>(data, file_size, header.strings);
+		db.namespaces = GetSection<BinDbScope>(data, file_size, header.namespaces);
+		db.types = GetSection<BinDbType>(data, file_size, header.types);
+		db.base_classes = GetSection<BinDbBaseClass>(data, file_size, header.base_classes);
+		db.fields = GetSection<BinDbField>(data, file_size, header.fields);
+		db.functions = GetSection<BinDbFunction>(data, file_size, header.functions);
+		db.parameters = GetSection<BinDbParameter>(data, file_size, header.parameters);
+		db.enum_entries = GetSection<BinDbEnumEntry>(data, file_size, header.enum_entries);
+		db.type_hash_seeds = GetSection<u32>(data, file_size, header.type_hash_seeds);
+
+		return
+			db.strings && db.namespaces && db.types && db.base_classes && db.fields &&
+			db.functions && db.parameters && db.enum_entries && db.type_hash_seeds &&
+			header.namespaces.count != 0;
+	}
+
+
+	// These functions check every index and range in the database before any objects are created, so
+	// that the read functions below can trust the data they're given.
+
+
+	bool ValidateName(const BinDb& db, const BinDbName& name)
+	{
+		return name.string_offset == BINDB_INVALID_INDEX || name.string_offset < db.header->strings.count;
+	}
+
+
+	bool ValidateIndex(u32 index, const BinDbSection& section)
+	{
+		return index == BINDB_INVALID_INDEX || index < section.count;
+	}
+
+
+	bool ValidateRange(const BinDbRange& range, const BinDbSection& section)
+	{
+		return range.first <= section.count && range.count <= section.count - range.first;
+	}
+
+
+	bool ClaimRange(std::vector<char>& claimed, const BinDbRange& range)
+	{
+		// Each namespace and type must be referenced by only one parent scope, which guarantees
+		// the scope hierarchy is a tree that can be safely recursed
+		for (u32 i = range.first; i < range.first + range.count; i++)
+		{
+			if (claimed[i])
+				return false;
+			claimed[i] = 1;
+		}
+
+		return true;
+	}
+
+
+	bool ValidateParameter(const BinDb& db, const BinDbParameter& param)
+	{
+		return ValidateName(db, param.name) && ValidateIndex(param.type, db.header->types);
+	}
+
+
+	bool ValidateScope(const BinDb& db, const BinDbScope& scope, std::vector<char>& claimed_namespaces, std::vector<char>& claimed_types)
+	{
+		const BinDbHeader& header = *db.header;
+
+		return
+			ValidateName(db, scope.name) &&
+			ValidateName(db, scope.full_name) &&
+			ValidateIndex(scope.meta_type, header.types) &&
+			ValidateRange(scope.namespaces, header.namespaces) &&
+			ValidateRange(scope.base_types, header.types) &&
+			ValidateRange(scope.classes, header.types) &&
+			ValidateRange(scope.templates, header.types) &&
+			ValidateRange(scope.template_instances, header.types) &&
+			ValidateRange(scope.enums, header.types) &&
+			ValidateRange(scope.functions, header.functions) &&
+			ClaimRange(claimed_namespaces, scope.namespaces) &&
+			ClaimRange(claimed_types, scope.base_types) &&
+			ClaimRange(claimed_types, scope.classes) &&
+			ClaimRange(claimed_types, scope.templates) &&
+			ClaimRange(claimed_types, scope.template_instances) &&
+			ClaimRange(claimed_types, scope.enums);
+	}
+
+
+	bool ValidateDb(const BinDb& db)
+	{
+		const BinDbHeader& header = *db.header;
+
+		// Strings are read in-place so the table must be terminated
+		if (header.strings.count && db.strings[header.strings.count - 1] != 0)
+			return false;
+
+		// The global namespace can't be the child of anything
+		std::vector<char> claimed_namespaces(header.namespaces.count, 0);
+		std::vector<char> claimed_types(header.types.count, 0);
+		claimed_namespaces[0] = 1;
+
+		for (u32 i = 0; i < header.namespaces.count; i++)
+		{
+			if (!ValidateScope(db, db.namespaces[i], claimed_namespaces, claimed_types))
+				return false;
+		}
+
+		for (u32 i = 0; i < header.types.count; i++)
+		{
+			const BinDbType& type = db.types[i];
+			if (!ValidateScope(db, type.scope, claimed_namespaces, claimed_types) ||
+				!ValidateRange(type.base_classes, header.base_classes) ||
+				!ValidateRange(type.fields, header.fields) ||
+				!ValidateRange(type.entries, header.enum_entries) ||
+				!ValidateIndex(type.instance_of, header.types) ||
+				!ValidateIndex(type.type0, header.types) ||
+				!ValidateIndex(type.type1, header.types))
+				return false;
+		}
+
+		for (u32 i = 0; i < header.base_classes.count; i++)
+		{
+			if (!ValidateIndex(db.base_classes[i].type, header.types))
+				return false;
+		}
+
+		for (u32 i = 0; i < header.fields.count; i++)
+		{
+			if (!ValidateParameter(db, db.fields[i].parameter))
+				return false;
+		}
+
+		for (u32 i = 0; i < header.functions.count; i++)
+		{
+			const BinDbFunction& function = db.functions[i];
+			if (!ValidateName(db, function.name) ||
+				!ValidateParameter(db, function.return_parameter) ||
+				!ValidateRange(function.parameters, header.parameters))
+				return false;
+		}
+
+		for (u32 i = 0; i < header.parameters.count; i++)
+		{
+			if (!ValidateParameter(db, db.parameters[i]))
+				return false;
+		}
+
+		for (u32 i = 0; i < header.enum_entries.count; i++)
+		{
+			if (!ValidateName(db, db.enum_entries[i].name))
+				return false;
+		}
+
+		return true;
+	}
+
+
+	void ReadName(const BinDb& db, const BinDbName& src, Name& name)
+	{
+		name.hash_id = src.hash_id;
+		if (!db.load_names || src.string_offset == BINDB_INVALID_INDEX)
+			return;
+
+		// Strings are copied once into the module's pool as the file is unmapped after loading
+		const char* string = db.names->Find(src.hash_id);
+		if (string == 0)
+		{
+			const char* src_string = db.strings + src.string_offset;
+			string = db.arena->AllocString(src_string, strlen(src_string));
+			db.names->Add(src.hash_id, string);
+		}
+
+#if RFL_NAME_STRINGS
+		name.string = string;
+#endif
+	}
+
+
+	void AddFixup(BinDb& db, const Type*& type_ptr, u32 type_index)
+	{
+		// Null references don't need patching
+		type_ptr = 0;
+		if (type_index != BINDB_INVALID_INDEX)
+		{
+			TypeFixup fixup = { &type_ptr, type_index };
+			db.fixups.push_back(fixup);
+		}
+	}
+
+
+	template <typename RECORD, typename TYPE> void ReadCollection(
+		BinDb& db,
+		const RECORD* records,
+		const BinDbRange& range,
+		Array<TYPE>& collection,
+		Scope* parent_scope,
+		void (*read_func)(BinDb&, const RECORD&, TYPE&, Scope*))
+	{
+		// The collection is sized exactly once, keeping object addresses stable for the fixups
+		collection.Allocate(*db.arena, range.count);
+		for (u32 i = 0; i < range.count; i++)
+			read_func(db, records[range.first + i], collection[i], parent_scope);
+	}
+
+
+	void ReadParameter(BinDb& db, const BinDbParameter& src, Parameter& param, Scope*)
+	{
+		ReadName(db, src.name, param.name);
+		AddFixup(db, param.type, src.type);
+		param.is_const = src.is_const != 0;
+		param.modifier = (Parameter::Modifier)src.modifier;
+		param.array_rank = src.array_rank;
+		param.array_length_0 = src.array_length_0;
+		param.array_length_1 = src.array_length_1;
+	}
+
+
+	void ReadField(BinDb& db, const BinDbField& src, Field& field, Scope* parent_scope)
+	{
+		ReadParameter(db, src.parameter, field, parent_scope);
+		field.offset = src.offset;
+	}
+
+
+	void ReadFunction(BinDb& db, const BinDbFunction& src, Function& function, Scope*)
+	{
+		ReadName(db, src.name, function.name);
+		function.call_address = src.call_address;
+		function.module = db.module;
+
+		ReadParameter(db, src.return_parameter, function.return_parameter, 0);
+		ReadCollection(db, db.parameters, src.parameters, function.parameters, 0, ReadParameter);
+	}
+
+
+	// Reads everything but the scope's functions
+	void ReadScope(BinDb& db, const BinDbScope& src, Scope& scope, Scope* parent_scope)
+	{
+		scope.parent_scope = parent_scope;
+		ReadName(db, src.name, scope.name);
+		ReadName(db, src.full_name, scope.full_name);
+		AddFixup(db, scope.type, src.meta_type);
+
+		// Leaf scopes don't get any children allocated
+		if (src.namespaces.count == 0 && src.base_types.count == 0 && src.classes.count == 0 &&
+			src.templates.count == 0 && src.template_instances.count == 0 && src.enums.count == 0)
+			return;
+
+		ScopeChildren& children = scope.AllocChildren(*db.arena);
+		ReadCollection(db, db.namespaces, src.namespaces, children.namespaces, &scope, ReadNamespace);
+		ReadCollection(db, db.types, src.base_types, children.base_types, &scope, ReadBaseType);
+		ReadCollection(db, db.types, src.classes, children.classes, &scope, ReadClass);
+		ReadCollection(db, db.types, src.templates, children.templates, &scope, ReadTemplate);
+		ReadCollection(db, db.types, src.template_instances, children.template_instances, &scope, ReadTemplateInstance);
+		ReadCollection(db, db.types, src.enums, children.enums, &scope, ReadEnum);
+	}
+
+
+	void ReadScopeFunctions(BinDb& db, const BinDbScope& src, Scope& scope)
+	{
+		if (src.functions.count)
+			ReadCollection(db, db.functions, src.functions, scope.AllocChildren(*db.arena).functions, &scope, ReadFunction);
+	}
+
+
+	void ReadNamespace(BinDb& db, const BinDbScope& src, Namespace& ns, Scope* parent_scope)
+	{
+		ReadScope(db, src, ns, parent_scope);
+		ReadScopeFunctions(db, src, ns);
+	}
+
+
+	const Function* GetFunction(const Type& type, u32 index)
+	{
+		if (index >= type.functions().size())
+			return 0;
+
+		return &type.functions()[index];
+	}
+
+
+	void ReadTypeFunctions(BinDb& db, const BinDbType& src, Type& type)
+	{
+		ReadScopeFunctions(db, src.scope, type);
+
+		// After the scope has collected the functions
+		type.constructor = GetFunction(type, src.constructor);
+		type.destructor = GetFunction(type, src.destructor);
+		type.copy_constructor = GetFunction(type, src.copy_constructor);
+		type.assignment_operator = GetFunction(type, src.assignment_operator);
+	}
+
+
+	// Returns false if the type's contents have been left for the lazy loader
+	bool ReadType(BinDb& db, const BinDbType& src, Type& type, Scope* parent_scope)
+	{
+		u32 index = u32(&src - db.types);
+		db.type_table[index] = &type;
+
+		type.unique_id = src.unique_id;
+		type.size = src.size;
+		type.typeof_va = src.typeof_va;
+
+		ReadScope(db, src.scope, type, parent_scope);
+
+		if (db.lazy_loader)
+		{
+			type.constructor = 0;
+			type.destructor = 0;
+			type.copy_constructor = 0;
+			type.assignment_operator = 0;
+			type.lazy_loader = db.lazy_loader;
+			type.lazy_index = index;
+			return false;
+		}
+
+		ReadTypeFunctions(db, src, type);
+		return true;
+	}
+
+
+	void ReadBaseType(BinDb& db, const BinDbType& src, BaseType& type, Scope* parent_scope)
+	{
+		ReadType(db, src, type, parent_scope);
+	}
+
+
+	void ReadBaseClass(BinDb& db, const BinDbBaseClass& src, Class::BaseClass& base, Scope*)
+	{
+		AddFixup(db, base.type, src.type);
+		base.offset = src.offset;
+	}
+
+
+	void ReadClassFields(BinDb& db, const BinDbType& src, Class& cls)
+	{
+		ReadCollection(db, db.fields, src.fields, cls.fields, &cls, ReadField);
+		db.classes.push_back(&cls);
+	}
+
+
+	void ReadClass(BinDb& db, const BinDbType& src, Class& cls, Scope* parent_scope)
+	{
+		cls.is_pod = src.is_pod != 0;
+
+		// Base classes are needed for type tests so aren't left for the lazy loader
+		ReadCollection(db, db.base_classes, src.base_classes, cls.base_classes, &cls, ReadBaseClass);
+		if (src.base_classes.count)
+			db.derived_classes.push_back(&cls);
+
+		if (ReadType(db, src, cls, parent_scope))
+			ReadClassFields(db, src, cls);
+		else
+			db.type_kinds[cls.lazy_index] = KIND_CLASS;
+	}
+
+
+	void ReadTemplate(BinDb& db, const BinDbType& src, Template& templ, Scope* parent_scope)
+	{
+		ReadType(db, src, templ, parent_scope);
+	}
+
+
+	void ReadTemplateInstance(BinDb& db, const BinDbType& src, TemplateInstance& instance, Scope* parent_scope)
+	{
+		AddFixup(db, (const Type*&)instance.instance_of, src.instance_of);
+		AddFixup(db, instance.type0, src.type0);
+		AddFixup(db, instance.type1, src.type1);
+
+		ReadType(db, src, instance, parent_scope);
+	}
+
+
+	void ReadEnumEntry(BinDb& db, const BinDbEnumEntry& src, Enum::Entry& entry, Scope*)
+	{
+		ReadName(db, src.name, entry.name);
+		entry.value = src.value;
+	}
+
+
+	void ReadEnumEntries(BinDb& db, const BinDbType& src, Enum& enm)
+	{
+		ReadCollection(db, db.enum_entries, src.entries, enm.entries, &enm, ReadEnumEntry);
+	}
+
+
+	void ReadEnum(BinDb& db, const BinDbType& src, Enum& enm, Scope* parent_scope)
+	{
+		if (ReadType(db, src, enm, parent_scope))
+			ReadEnumEntries(db, src, enm);
+		else
+			db.type_kinds[enm.lazy_index] = KIND_ENUM;
+	}
+
+
+	void PatchTypePointers(BinDb& db)
+	{
+		// Every type has been allocated so the fixups can be applied in one linear pass
+		for (size_t i = 0; i < db.fixups.size(); i++)
+		{
+			const TypeFixup& fixup = db.fixups[i];
+			*fixup.type_ptr = db.module->ResolveType(db.type_table[fixup.type_index]);
+		}
+
+		for (size_t i = 0; i < db.classes.size(); i++)
+			db.classes[i]->BuildFieldTable(*db.arena);
+
+		db.fixups.clear();
+		db.classes.clear();
+	}
+
+
+	void BinDbLazyLoader::MaterialiseType(Type& type)
+	{
+		const BinDbType& src = db.types[type.lazy_index];
+
+		// Indexes built at load only cover what was read then, so are rebuilt with the new contents
+		ReadTypeFunctions(db, src, type);
+		if (db.type_kinds[type.lazy_index] == KIND_CLASS)
+		{
+			Class& cls = static_cast<Class&>(type);
+			ReadClassFields(db, src, cls);
+			cls.BuildNameIndexes(*db.arena);
+		}
+		else if (db.type_kinds[type.lazy_index] == KIND_ENUM)
+		{
+			Enum& enm = static_cast<Enum&>(type);
+			ReadEnumEntries(db, src, enm);
+			enm.BuildNameIndexes(*db.arena);
+		}
+		else
+		{
+			type.BuildNameIndexes(*db.arena);
+		}
+		type.lazy_loader = 0;
+
+		// All types exist by now so the new type references can be patched straight away
+		PatchTypePointers(db);
+
+		// Needs the field table, which is only built by the patch
+		if (db.type_kinds[type.lazy_index] == KIND_CLASS)
+			static_cast<Class&>(type).BuildSerialisePlan(*db.arena);
+	}
+
+
+	void PopulateTypeIndex(BinDb& db, TypeIndex& type_index)
+	{
+		type_index.Reserve(db.header->types.count);
+
+		for (size_t i = 0; i < db.type_table.size(); i++)
+		{
+			if (Type* type = db.type_table[i])
+				type_index.Add(type->full_name.hash_id, type);
+		}
+	}
+}
+
+
+Module* BinDbReader::LoadModule(const char* bin_file, u32 flags, LoadStats* stats, const ModuleBinding* binding)
+{
+	LoadStats local_stats;
+	LoadStats& load_stats = stats ? *stats : local_stats;
+	load_stats.BeginLoad();
+
+	// Map the file and check it's a database this code understands
+	u32 file_size = 0;
+	const char* data = (const char*)Win32::MapFile(bin_file, file_size);
+	load_stats.EndPhase(LoadStats::PHASE_MAP_FILE);
+	if (data == 0)
+	{
+		load_stats.EndLoad(bin_file, 0);
+		return 0;
+	}
+	load_stats.bytes_read = file_size;
+
+	// Lazily loaded modules keep the file mapped for as long as they're alive
+	BinDbLazyLoader* lazy_loader = 0;
+	BinDb local_db;
+	BinDb* db = &local_db;
+	if (flags & LOAD_LAZY)
+	{
+		lazy_loader = new BinDbLazyLoader(data);
+		db = &lazy_loader->db;
+	}
+	db->lazy_loader = lazy_loader;
+
+	Module* module = 0;
+	bool valid = OpenDb(*db, data, file_size) && ValidateDb(*db);
+	load_stats.EndPhase(LoadStats::PHASE_SCAN);
+	if (valid)
+	{
+		ModuleBinding default_binding;
+		module = new Module;
+		(binding ? binding : &default_binding)->Bind(*module);
+		module->lazy_loader = lazy_loader;
+		db->module = module;
+		db->arena = &module->arena;
+		db->names = &module->names;
+		db->load_names = !(flags & LOAD_NO_NAMES);
+		db->type_table.resize(db->header->types.count, 0);
+		if (lazy_loader)
+			db->type_kinds.resize(db->header->types.count, KIND_OTHER);
+
+		// Build the objects straight from the records, patching type references after the
+		// last type has been allocated
+		ReadNamespace(*db, db->namespaces[0], module->global_namespace, 0);
+		module->global_namespace.BuildNameIndexes(module->arena);
+		load_stats.EndPhase(LoadStats::PHASE_BUILD);
+
+		PatchTypePointers(*db);
+		for (size_t i = 0; i < db->derived_classes.size(); i++)
+			db->derived_classes[i]->BuildHierarchy(module->arena);
+		db->derived_classes.clear();
+		PopulateTypeIndex(*db, module->types);
+		if (!module->type_hash.Place(module->arena, module->types, db->type_hash_seeds, db->header->type_hash_seeds.count))
+			module->type_hash.Build(module->arena, module->types);
+		module->BuildTypeTraits();
+		load_stats.EndPhase(LoadStats::PHASE_PATCH_TYPES);
+
+		if (!(flags & LOAD_NO_TYPEOF_PATCH))
+			UpdateTypeOfPointers(*module);
+		load_stats.EndPhase(LoadStats::PHASE_UPDATE_MODULE_POINTERS);
+	}
+
+	if (lazy_loader == 0)
+		Win32::UnmapFile(data);
+	else if (module == 0)
+		delete lazy_loader;
+
+	load_stats.EndLoad(bin_file, module);
+	return module;
+}
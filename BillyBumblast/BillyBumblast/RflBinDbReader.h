@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Core.h"
+
+
+namespace rfl
+{
+	struct Module;
+	struct LoadStats;
+	struct ModuleBinding;
+
+
+	struct BinDbReader
+	{
+		// Values don't overlap with XmlDbReader::Flags so that the same flags can be passed to both
+		enum Flags
+		{
+			// Don't point the TypeOf pointers in the program at the loaded types
+			// Same as XmlDbReader::LOAD_NO_TYPEOF_PATCH
+			LOAD_NO_TYPEOF_PATCH = 2,
+
+			// Only load type headers up-front, with functions, fields and enum entries loaded the
+			// first time each type is used
+			LOAD_LAZY = 4,
+
+			// Leave the module's debug string pool empty, with only name hashes loaded
+			// Same as XmlDbReader::LOAD_NO_NAMES
+			LOAD_NO_NAMES = 8,
+		};
+
+		static Module* LoadModule(const char* bin_file, u32 flags = 0, LoadStats* stats = 0, const ModuleBinding* binding = 0);
+	};
+}
@@ -0,0 +1,419 @@
+#include "RflBinDbWriter.h"
+#include "RflBinDb.h"
+#include "Rfl.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace rfl;
+
+
+namespace
+{
+	struct BinDbBuilder
+	{
+		// Name strings are taken from the module's debug string pool, so are only written if it was loaded
+		const NamePool* names;
+		std::vector<char> strings;
+		std::map<u32, u32> string_offsets;
+
+		std::vector<BinDbScope> namespaces;
+		std::vector<BinDbType> types;
+		std::vector<BinDbBaseClass> base_classes;
+		std::vector<BinDbField> fields;
+		std::vector<BinDbFunction> functions;
+		std::vector<BinDbParameter> parameters;
+		std::vector<BinDbEnumEntry> enum_entries;
+		std::vector<u32> type_hash_seeds;
+
+		// Type references are initially written as indices into this list and converted to type
+		// record indices once every type has been placed
+		std::vector<const Type*> type_refs;
+		std::map<const Type*, u32> type_indices;
+
+		// Type record indices by full name, for references that were resolved to another module's types
+		std::map<u32, u32> type_indices_by_name;
+	};
+
+
+	BinDbScope WriteScope(BinDbBuilder& builder, const Scope& scope);
+	BinDbType WriteBaseType(BinDbBuilder& builder, const BaseType& type);
+	BinDbType WriteClass(BinDbBuilder& builder, const Class& cls);
+	BinDbType WriteTemplate(BinDbBuilder& builder, const Template& templ);
+	BinDbType WriteTemplateInstance(BinDbBuilder& builder, const TemplateInstance& instance);
+	BinDbType WriteEnum(BinDbBuilder& builder, const Enum& enm);
+	BinDbFunction WriteFunction(BinDbBuilder& builder, const Function& function);
+
+
+	BinDbName WriteName(BinDbBuilder& builder, const Name& name)
+	{
+		BinDbName dst = { name.hash_id, BINDB_INVALID_INDEX };
+
+		const char* string = builder.names->Find(name.hash_id);
+		if (string && string[0])
+		{
+			// Strings are shared between all names with the same hash
+			std::map<u32, u32>::iterator i = builder.string_offsets.find(name.hash_id);
+			if (i == builder.string_offsets.end())
+			{
+				u32 offset = (u32)builder.strings.size();
+				builder.strings.insert(builder.strings.end(), string, string + strlen(string));
+				builder.strings.push_back(0);
+				i = builder.string_offsets.insert(std::make_pair(name.hash_id, offset)).first;
+			}
+
+			dst.string_offset = i->second;
+		}
+
+		return dst;
+	}
+
+
+	u32 WriteTypeRef(BinDbBuilder& builder, const Type* type)
+	{
+		if (type == 0)
+			return BINDB_INVALID_INDEX;
+
+		builder.type_refs.push_back(type);
+		return (u32)builder.type_refs.size() - 1;
+	}
+
+
+	template <typename RECORD> BinDbRange AllocateRange(std::vector<RECORD>& records, size_t count)
+	{
+		BinDbRange range = { (u32)records.size(), (u32)count };
+		records.resize(records.size() + count);
+		return range;
+	}
+
+
+	// Children are allocated as a contiguous range before they're written, which keeps the records of
+	// each collection together. The records vector can grow while a child is being written so each
+	// child record is built on the stack and only then copied in.
+	template <typename RECORD, typename TYPE> BinDbRange WriteCollection(
+		BinDbBuilder& builder,
+		std::vector<RECORD>& records,
+		const Array<TYPE>& collection,
+		RECORD (*write_func)(BinDbBuilder&, const TYPE&))
+	{
+		BinDbRange range = AllocateRange(records, collection.size());
+		for (size_t i = 0; i < collection.size(); i++)
+		{
+			RECORD record = write_func(builder, collection[i]);
+			records[range.first + i] = record;
+		}
+
+		return range;
+	}
+
+
+	template <typename TYPE> BinDbRange WriteTypeCollection(
+		BinDbBuilder& builder,
+		const Array<TYPE>& collection,
+		BinDbType (*write_func)(BinDbBuilder&, const TYPE&))
+	{
+		// Record where each type lives before writing any of them so that they can reference each other
+		BinDbRange range = AllocateRange(builder.types, collection.size());
+		for (size_t i = 0; i < collection.size(); i++)
+		{
+			builder.type_indices[&collection[i]] = range.first + (u32)i;
+			builder.type_indices_by_name.insert(std::make_pair(collection[i].full_name.hash_id, range.first + (u32)i));
+		}
+
+		for (size_t i = 0; i < collection.size(); i++)
+		{
+			BinDbType record = write_func(builder, collection[i]);
+			builder.types[range.first + i] = record;
+		}
+
+		return range;
+	}
+
+
+	BinDbParameter WriteParameter(BinDbBuilder& builder, const Parameter& param)
+	{
+		BinDbParameter dst;
+		dst.name = WriteName(builder, param.name);
+		dst.type = WriteTypeRef(builder, param.type);
+		dst.is_const = param.is_const;
+		dst.modifier = param.modifier;
+		dst.array_rank = param.array_rank;
+		dst.array_length_0 = param.array_length_0;
+		dst.array_length_1 = param.array_length_1;
+		return dst;
+	}
+
+
+	BinDbBaseClass WriteBaseClass(BinDbBuilder& builder, const Class::BaseClass& base)
+	{
+		BinDbBaseClass dst;
+		dst.type = WriteTypeRef(builder, base.type);
+		dst.offset = base.offset;
+		return dst;
+	}
+
+
+	BinDbField WriteField(BinDbBuilder& builder, const Field& field)
+	{
+		BinDbField dst;
+		dst.parameter = WriteParameter(builder, field);
+		dst.offset = field.offset;
+		return dst;
+	}
+
+
+	BinDbFunction WriteFunction(BinDbBuilder& builder, const Function& function)
+	{
+		BinDbFunction dst;
+		dst.name = WriteName(builder, function.name);
+		dst.call_address = function.call_address;
+		dst.return_parameter = WriteParameter(builder, function.return_parameter);
+		dst.parameters = WriteCollection(builder, builder.parameters, function.parameters, WriteParameter);
+		return dst;
+	}
+
+
+	BinDbScope WriteNamespace(BinDbBuilder& builder, const Namespace& ns)
+	{
+		return WriteScope(builder, ns);
+	}
+
+
+	BinDbScope WriteScope(BinDbBuilder& builder, const Scope& scope)
+	{
+		BinDbScope dst;
+		dst.name = WriteName(builder, scope.name);
+		dst.full_name = WriteName(builder, scope.full_name);
+		dst.meta_type = WriteTypeRef(builder, scope.type);
+
+		dst.namespaces = WriteCollection(builder, builder.namespaces, scope.namespaces(), WriteNamespace);
+		dst.base_types = WriteTypeCollection(builder, scope.base_types(), WriteBaseType);
+		dst.classes = WriteTypeCollection(builder, scope.classes(), WriteClass);
+		dst.templates = WriteTypeCollection(builder, scope.templates(), WriteTemplate);
+		dst.template_instances = WriteTypeCollection(builder, scope.template_instances(), WriteTemplateInstance);
+		dst.enums = WriteTypeCollection(builder, scope.enums(), WriteEnum);
+		dst.functions = WriteCollection(builder, builder.functions, scope.functions(), WriteFunction);
+		return dst;
+	}
+
+
+	u32 GetFunctionIndex(const Type& type, const Function* function)
+	{
+		// Types that the loader couldn't patch still hold their sentinel values, so only accept
+		// pointers into this type's own functions
+		for (size_t i = 0; i < type.functions().size(); i++)
+		{
+			if (&type.functions()[i] == function)
+				return (u32)i;
+		}
+
+		return BINDB_INVALID_INDEX;
+	}
+
+
+	BinDbType WriteType(BinDbBuilder& builder, const Type& type)
+	{
+		// Lazily loaded types need their full contents before they can be written
+		type.Materialise();
+
+		BinDbType dst;
+		memset(&dst, 0, sizeof(dst));
+
+		dst.scope = WriteScope(builder, type);
+		dst.unique_id = type.unique_id;
+		dst.size = type.size;
+		dst.typeof_va = type.typeof_va;
+
+		dst.constructor = GetFunctionIndex(type, type.constructor);
+		dst.destructor = GetFunctionIndex(type, type.destructor);
+		dst.copy_constructor = GetFunctionIndex(type, type.copy_constructor);
+		dst.assignment_operator = GetFunctionIndex(type, type.assignment_operator);
+
+		dst.instance_of = BINDB_INVALID_INDEX;
+		dst.type0 = BINDB_INVALID_INDEX;
+		dst.type1 = BINDB_INVALID_INDEX;
+		return dst;
+	}
+
+
+	BinDbType WriteBaseType(BinDbBuilder& builder, const BaseType& type)
+	{
+		return WriteType(builder, type);
+	}
+
+
+	BinDbType WriteClass(BinDbBuilder& builder, const Class& cls)
+	{
+		BinDbType dst = WriteType(builder, cls);
+		dst.is_pod = cls.is_pod;
+		dst.base_classes = WriteCollection(builder, builder.base_classes, cls.base_classes, WriteBaseClass);
+		dst.fields = WriteCollection(builder, builder.fields, cls.fields, WriteField);
+		return dst;
+	}
+
+
+	BinDbType WriteTemplate(BinDbBuilder& builder, const Template& templ)
+	{
+		return WriteType(builder, templ);
+	}
+
+
+	BinDbType WriteTemplateInstance(BinDbBuilder& builder, const TemplateInstance& instance)
+	{
+		BinDbType dst = WriteType(builder, instance);
+		dst.instance_of = WriteTypeRef(builder, instance.instance_of);
+		dst.type0 = WriteTypeRef(builder, instance.type0);
+		dst.type1 = WriteTypeRef(builder, instance.type1);
+		return dst;
+	}
+
+
+	BinDbEnumEntry WriteEnumEntry(BinDbBuilder& builder, const Enum::Entry& entry)
+	{
+		BinDbEnumEntry dst;
+		dst.name = WriteName(builder, entry.name);
+		dst.value = entry.value;
+		return dst;
+	}
+
+
+	BinDbType WriteEnum(BinDbBuilder& builder, const Enum& enm)
+	{
+		BinDbType dst = WriteType(builder, enm);
+		dst.entries = WriteCollection(builder, builder.enum_entries, enm.entries, WriteEnumEntry);
+		return dst;
+	}
+
+
+	// These functions convert the temporary type references into type record indices, now that every
+	// type in the module has been placed. Modules loaded through a registry reference the shared types
+	// of earlier modules, which are written as this module's type with the same name. The loader maps
+	// those back to the shared types. References to types the module has no record of are written as null.
+
+
+	void ResolveTypeRef(BinDbBuilder& builder, u32& type_ref)
+	{
+		if (type_ref == BINDB_INVALID_INDEX)
+			return;
+
+		const Type* type = builder.type_refs[type_ref];
+		std::map<const Type*, u32>::iterator i = builder.type_indices.find(type);
+		if (i != builder.type_indices.end())
+		{
+			type_ref = i->second;
+			return;
+		}
+
+		std::map<u32, u32>::iterator j = builder.type_indices_by_name.find(type->full_name.hash_id);
+		type_ref = j == builder.type_indices_by_name.end() ? BINDB_INVALID_INDEX : j->second;
+	}
+
+
+	void ResolveTypeRefs(BinDbBuilder& builder)
+	{
+		for (size_t i = 0; i < builder.namespaces.size(); i++)
+			ResolveTypeRef(builder, builder.namespaces[i].meta_type);
+
+		for (size_t i = 0; i < builder.types.size(); i++)
+		{
+			BinDbType& type = builder.types[i];
+			ResolveTypeRef(builder, type.scope.meta_type);
+			ResolveTypeRef(builder, type.instance_of);
+			ResolveTypeRef(builder, type.type0);
+			ResolveTypeRef(builder, type.type1);
+		}
+
+		for (size_t i = 0; i < builder.base_classes.size(); i++)
+			ResolveTypeRef(builder, builder.base_classes[i].type);
+
+		for (size_t i = 0; i < builder.fields.size(); i++)
+			ResolveTypeRef(builder, builder.fields[i].parameter.type);
+
+		for (size_t i = 0; i < builder.functions.size(); i++)
+			ResolveTypeRef(builder, builder.functions[i].return_parameter.type);
+
+		for (size_t i = 0; i < builder.parameters.size(); i++)
+			ResolveTypeRef(builder, builder.parameters[i].type);
+	}
+
+
+	void WriteTypeHashSeeds(BinDbBuilder& builder)
+	{
+		// The loader indexes types by full name, so duplicates only take one slot
+		std::vector<u32> hash_ids(builder.types.size());
+		for (size_t i = 0; i < builder.types.size(); i++)
+			hash_ids[i] = builder.types[i].scope.full_name.hash_id;
+		std::sort(hash_ids.begin(), hash_ids.end());
+		hash_ids.erase(std::unique(hash_ids.begin(), hash_ids.end()), hash_ids.end());
+
+		// Left empty if there's no perfect hash, for the loader to try again
+		if (!TypePerfectHash::FindSeeds(hash_ids, builder.type_hash_seeds))
+			builder.type_hash_seeds.clear();
+	}
+
+
+	template <typename RECORD> BinDbSection PlaceSection(u32& offset, const std::vector<RECORD>& records)
+	{
+		BinDbSection section = { offset, (u32)records.size() };
+		offset += (u32)(records.size() * sizeof(RECORD));
+		return section;
+	}
+
+
+	template <typename RECORD> bool WriteSection(FILE* fp, const std::vector<RECORD>& records)
+	{
+		if (records.empty())
+			return true;
+
+		return fwrite(&records[0], sizeof(RECORD), records.size(), fp) == records.size();
+	}
+}
+
+
+bool BinDbWriter::WriteModule(const Module* module, const char* bin_file)
+{
+	// Flatten the module into record arrays, starting with the global namespace at index 0
+	BinDbBuilder builder;
+	builder.names = &module->names;
+	AllocateRange(builder.namespaces, 1);
+	BinDbScope global_namespace = WriteScope(builder, module->global_namespace);
+	builder.namespaces[0] = global_namespace;
+	ResolveTypeRefs(builder);
+	WriteTypeHashSeeds(builder);
+
+	// Lay out the sections one after the other, leaving the strings until last as they're the
+	// only records that aren't a multiple of 4 bytes in size
+	BinDbHeader header;
+	u32 offset = sizeof(header);
+	header.magic = BINDB_MAGIC;
+	header.version = BINDB_VERSION;
+	header.namespaces = PlaceSection(offset, builder.namespaces);
+	header.types = PlaceSection(offset, builder.types);
+	header.base_classes = PlaceSection(offset, builder.base_classes);
+	header.fields = PlaceSection(offset, builder.fields);
+	header.functions = PlaceSection(offset, builder.functions);
+	header.parameters = PlaceSection(offset, builder.parameters);
+	header.enum_entries = PlaceSection(offset, builder.enum_entries);
+	header.type_hash_seeds = PlaceSection(offset, builder.type_hash_seeds);
+	header.strings = PlaceSection(offset, builder.strings);
+	header.file_size = offset;
+
+	FILE* fp = fopen(bin_file, "wb");
+	if (fp == 0)
+		return false;
+
+	bool written =
+		fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		WriteSection(fp, builder.namespaces) &&
+		WriteSection(fp, builder.types) &&
+		WriteSection(fp, builder.base_classes) &&
+		WriteSection(fp, builder.fields) &&
+		WriteSection(fp, builder.functions) &&
+		WriteSection(fp, builder.parameters) &&
+		WriteSection(fp, builder.enum_entries) &&
+		WriteSection(fp, builder.type_hash_seeds) &&
+		WriteSection(fp, builder.strings);
+
+	fclose(fp);
+	return written;
+}
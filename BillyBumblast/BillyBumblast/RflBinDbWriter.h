@@ -0,0 +1,13 @@
+#pragma once
+
+
+namespace rfl
+{
+	struct Module;
+
+
+	struct BinDbWriter
+	{
+		static bool WriteModule(const Module* module, const char* bin_file);
+	};
+}
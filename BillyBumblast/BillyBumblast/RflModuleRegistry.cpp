@@ -0,0 +1,94 @@
+
+#include "RflModuleRegistry.h"
+#include "RflBinDbReader.h"
+#include "RflBinDbWriter.h"
+#include "RflXmlDbReader.h"
+#include "Win32.h"
+
+using namespace rfl;
+
+
+namespace
+{
+	void AddModuleTypes(TypeIndex& types, const Module& module)
+	{
+		types.Reserve(types.count + module.types.count);
+
+		// Types already provided by an earlier module keep their entry
+		for (size_t i = 0; i < module.types.entries.size(); i++)
+		{
+			const TypeIndex::Entry& entry = module.types.entries[i];
+			if (entry.type && types.Find(entry.hash_id) == 0)
+				types.Add(entry.hash_id, entry.type);
+		}
+	}
+}
+
+
+ModuleRegistry::~ModuleRegistry()
+{
+	while (!modules.empty())
+		UnloadModule(modules.back());
+}
+
+
+Module* ModuleRegistry::LoadModule(const char* xml_file, const char* bin_file, u64 base_address, u32 flags, LoadStats* stats)
+{
+	ModuleBinding binding;
+	binding.base_address = base_address;
+	binding.shared_types = &types;
+
+	// Use the binary database as long as it's been generated from the latest XML database
+	Module* module = 0;
+	if (bin_file && Win32::GetFileTimestamp(bin_file) >= Win32::GetFileTimestamp(xml_file))
+		module = BinDbReader::LoadModule(bin_file, flags, stats, &binding);
+	// Otherwise fall back to the XML and convert it for next time
+	if (module == 0)
+	{
+		module = XmlDbReader::LoadModule(xml_file, flags, stats, &binding);
+		if (module && bin_file)
+			BinDbWriter::WriteModule(module, bin_file);
+	}
+
+	if (module)
+	{
+		modules.push_back(module);
+		AddModuleTypes(types, *module);
+	}
+
+	return module;
+}
+
+
+bool ModuleRegistry::UnloadModule(Module* module)
+{
+	if (modules.empty() || modules.back() != module)
+		return false;
+
+	modules.pop_back();
+	rfl::UnloadModule(module);
+
+	// Types the unloaded module provided may also be provided by others so rebuild the index
+	// from what remains, in load order
+	types.entries.clear();
+	types.count = 0;
+	for (size_t j = 0; j < modules.size(); j++)
+		AddModuleTypes(types, *modules[j]);
+
+	return true;
+}
+
+
+Type* ModuleRegistry::FindType(u32 hash_id) const
+{
+	Type* type = types.Find(hash_id);
+	if (type)
+		type->Materialise();
+	return type;
+}
+
+
+Type* ModuleRegistry::FindType(const char* full_name) const
+{
+	return FindType(Name(full_name).hash_id);
+}
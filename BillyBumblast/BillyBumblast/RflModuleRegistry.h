@@ -0,0 +1,38 @@
+
+#pragma once
+
+#include "Rfl.h"
+
+
+namespace rfl
+{
+	struct LoadStats;
+
+
+	//
+	// Tracks the modules loaded for each binary in the process (e.g. the executable and its plugin DLLs).
+	// Types are shared between modules through a global index, where the first module to load a type
+	// provides it to every module loaded after.
+	//
+	struct ModuleRegistry
+	{
+		~ModuleRegistry();
+
+		// Load the database for a binary that's already loaded at the given address, only building the
+		// types in that database. Loads the binary database if it's up to date, otherwise the XML database
+		// which is then converted to binary for next time.
+		Module* LoadModule(const char* xml_file, const char* bin_file, u64 base_address, u32 flags = 0, LoadStats* stats = 0);
+
+		// Modules loaded after this one may reference its types, so only the most recently loaded module
+		// can be unloaded. Returns false, leaving the module loaded, for any other module.
+		bool UnloadModule(Module* module);
+
+		Type* FindType(u32 hash_id) const;
+		Type* FindType(const char* full_name) const;
+
+		std::vector<Module*> modules;
+
+		// Every type in every module
+		TypeIndex types;
+	};
+}
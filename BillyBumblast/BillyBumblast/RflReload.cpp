@@ -0,0 +1,398 @@
+
+#include "Rfl.h"
+#include "RflXmlDbReader.h"
+#include "Win32.h"
+
+using namespace rfl;
+
+
+namespace
+{
+	// Types are matched between the loaded module and the reloaded database by their full name, with
+	// references to types in the reloaded database redirected to any existing type of the same name.
+	// That way existing Type pointers stay valid and new data never points at the discarded copies.
+
+
+	const Type* RemapType(const Module& module, const Type* type)
+	{
+		if (type == 0)
+			return 0;
+
+		Type* existing = module.types.Find(type->full_name.hash_id);
+		return module.ResolveType(existing ? existing : (Type*)type);
+	}
+
+
+	void RemapParameter(const Module& module, Parameter& param)
+	{
+		param.type = RemapType(module, param.type);
+	}
+
+
+	void RemapFunctions(const Module& module, Scope& scope)
+	{
+		if (scope.children == 0)
+			return;
+
+		Array<Function>& functions = scope.children->functions;
+		for (size_t i = 0; i < functions.size(); i++)
+		{
+			// The module the functions were loaded into is about to be deleted
+			Function& function = functions[i];
+			function.module = &module;
+			RemapParameter(module, function.return_parameter);
+			for (size_t j = 0; j < function.parameters.size(); j++)
+				RemapParameter(module, function.parameters[j]);
+		}
+	}
+
+
+	void RemapFields(const Module& module, Array<Field>& fields)
+	{
+		for (size_t i = 0; i < fields.size(); i++)
+			RemapParameter(module, fields[i]);
+	}
+
+
+	void RemapBaseClasses(const Module& module, Array<Class::BaseClass>& base_classes)
+	{
+		for (size_t i = 0; i < base_classes.size(); i++)
+			base_classes[i].type = RemapType(module, base_classes[i].type);
+	}
+
+
+	void AdoptChildren(const Module& module, ScopeChildren* children, Scope* parent_scope);
+
+
+	template <typename TYPE>
+	void AdoptScopes(const Module& module, Array<TYPE>& scopes, Scope* parent_scope)
+	{
+		for (size_t i = 0; i < scopes.size(); i++)
+		{
+			Scope& scope = scopes[i];
+			scope.parent_scope = parent_scope;
+			RemapFunctions(module, scope);
+			AdoptChildren(module, scope.children, &scope);
+		}
+	}
+
+
+	// Point the scopes of the reloaded database that outlive it at the module adopting them
+	void AdoptChildren(const Module& module, ScopeChildren* children, Scope* parent_scope)
+	{
+		if (children == 0)
+			return;
+
+		AdoptScopes(module, children->namespaces, parent_scope);
+		AdoptScopes(module, children->base_types, parent_scope);
+		AdoptScopes(module, children->classes, parent_scope);
+		AdoptScopes(module, children->templates, parent_scope);
+		AdoptScopes(module, children->template_instances, parent_scope);
+		AdoptScopes(module, children->enums, parent_scope);
+	}
+
+
+	u32 GetTypeHash(const Type* type)
+	{
+		return type ? type->full_name.hash_id : 0;
+	}
+
+
+	bool BaseClassesEqual(const Array<Class::BaseClass>& a, const Array<Class::BaseClass>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (GetTypeHash(a[i].type) != GetTypeHash(b[i].type) || a[i].offset != b[i].offset)
+				return false;
+		}
+
+		return true;
+	}
+
+
+	bool ParametersEqual(const Parameter& a, const Parameter& b)
+	{
+		return
+			a.name.hash_id == b.name.hash_id &&
+			GetTypeHash(a.type) == GetTypeHash(b.type) &&
+			a.is_const == b.is_const &&
+			a.modifier == b.modifier &&
+			a.array_rank == b.array_rank &&
+			a.array_length_0 == b.array_length_0 &&
+			a.array_length_1 == b.array_length_1;
+	}
+
+
+	bool FieldsEqual(const Array<Field>& a, const Array<Field>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (a[i].offset != b[i].offset || !ParametersEqual(a[i], b[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+
+	bool FunctionsEqual(const Array<Function>& a, const Array<Function>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			const Function& fa = a[i];
+			const Function& fb = b[i];
+			if (fa.name.hash_id != fb.name.hash_id ||
+				fa.call_address != fb.call_address ||
+				fa.parameters.size() != fb.parameters.size() ||
+				!ParametersEqual(fa.return_parameter, fb.return_parameter))
+				return false;
+
+			for (size_t j = 0; j < fa.parameters.size(); j++)
+			{
+				if (!ParametersEqual(fa.parameters[j], fb.parameters[j]))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+
+	bool EntriesEqual(const Array<Enum::Entry>& a, const Array<Enum::Entry>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (a[i].name.hash_id != b[i].name.hash_id || a[i].value != b[i].value)
+				return false;
+		}
+
+		return true;
+	}
+
+
+	// Reload results are accumulated here
+	struct ReloadState
+	{
+		Module* module;
+
+		// Arena of the reloaded database, which replaced data is allocated from
+		Arena* arena;
+
+		// Every class in the reloaded database, which all have their hierarchy rebuilt if any of
+		// their base classes have changed
+		std::vector<Class*> classes;
+		bool hierarchy_changed;
+	};
+
+
+	void UpdateFunctions(ReloadState& reload, Type& type, Type& new_type)
+	{
+		// Lazily loaded types are replaced without being loaded first
+		if (type.lazy_loader == 0 && FunctionsEqual(type.functions(), new_type.functions()))
+			return;
+
+		// The new functions live in the reloaded arena, which is kept alive by the module
+		RemapFunctions(*reload.module, new_type);
+		if (type.children || !new_type.functions().empty())
+		{
+			ScopeChildren& children = type.AllocChildren(*reload.arena);
+			children.functions = new_type.functions();
+			children.function_index = new_type.GetChildren().function_index;
+		}
+		type.constructor = new_type.constructor;
+		type.destructor = new_type.destructor;
+		type.copy_constructor = new_type.copy_constructor;
+		type.assignment_operator = new_type.assignment_operator;
+	}
+
+
+	void UpdateType(ReloadState& reload, Type& type, Type& new_type)
+	{
+		// The kind decides how the type's contents are laid out, so a type can't be updated in place
+		// if it has changed kind (e.g. from class to enum)
+		if (new_type.kind != type.kind)
+			return;
+
+		type.unique_id = new_type.unique_id;
+		type.size = new_type.size;
+		type.typeof_va = new_type.typeof_va;
+
+		UpdateFunctions(reload, type, new_type);
+
+		switch (type.kind)
+		{
+		case Type::KIND_CLASS:
+		{
+			Class& cls = static_cast<Class&>(type);
+			Class& new_cls = static_cast<Class&>(new_type);
+			cls.is_pod = new_cls.is_pod;
+			reload.classes.push_back(&cls);
+			if (!BaseClassesEqual(cls.base_classes, new_cls.base_classes))
+			{
+				RemapBaseClasses(*reload.module, new_cls.base_classes);
+				cls.base_classes = new_cls.base_classes;
+				reload.hierarchy_changed = true;
+			}
+			if (type.lazy_loader || !FieldsEqual(cls.fields, new_cls.fields))
+			{
+				RemapFields(*reload.module, new_cls.fields);
+				cls.fields = new_cls.fields;
+				cls.field_index = new_cls.field_index;
+				cls.BuildFieldTable(*reload.arena);
+			}
+			break;
+		}
+
+		case Type::KIND_ENUM:
+		{
+			Enum& enm = static_cast<Enum&>(type);
+			Enum& new_enm = static_cast<Enum&>(new_type);
+			if (type.lazy_loader || !EntriesEqual(enm.entries, new_enm.entries))
+			{
+				enm.entries = new_enm.entries;
+				enm.entry_index = new_enm.entry_index;
+			}
+			break;
+		}
+
+		case Type::KIND_TEMPLATE_INSTANCE:
+		{
+			TemplateInstance& instance = static_cast<TemplateInstance&>(type);
+			TemplateInstance& new_instance = static_cast<TemplateInstance&>(new_type);
+			instance.instance_of = (Template*)RemapType(*reload.module, new_instance.instance_of);
+			instance.type0 = RemapType(*reload.module, new_instance.type0);
+			instance.type1 = RemapType(*reload.module, new_instance.type1);
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		// Everything the lazy loader would have provided has been replaced
+		type.lazy_loader = 0;
+	}
+
+
+	void AddType(ReloadState& reload, Type& new_type)
+	{
+		// New types keep their place in the reloaded scope tree, so are only reachable through the
+		// module's type index
+		new_type.type = RemapType(*reload.module, new_type.type);
+		RemapFunctions(*reload.module, new_type);
+
+		switch (new_type.kind)
+		{
+		case Type::KIND_CLASS:
+		{
+			Class& cls = static_cast<Class&>(new_type);
+			RemapFields(*reload.module, cls.fields);
+			cls.BuildFieldTable(*reload.arena);
+
+			// The hierarchy built by the loader points at types in the reloaded database
+			RemapBaseClasses(*reload.module, cls.base_classes);
+			reload.classes.push_back(&cls);
+			reload.hierarchy_changed |= !cls.base_classes.empty();
+			break;
+		}
+
+		case Type::KIND_TEMPLATE_INSTANCE:
+		{
+			TemplateInstance& instance = static_cast<TemplateInstance&>(new_type);
+			instance.instance_of = (Template*)RemapType(*reload.module, instance.instance_of);
+			instance.type0 = RemapType(*reload.module, instance.type0);
+			instance.type1 = RemapType(*reload.module, instance.type1);
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+}
+
+
+bool Module::Reload(const char* xml_file)
+{
+	// Load the new database as a module of its own to diff against, leaving the TypeOf pointers alone
+	ModuleBinding binding;
+	binding.base_address = base_address;
+	binding.shared_types = shared_types;
+	Module* new_module = XmlDbReader::LoadModule(xml_file, XmlDbReader::LOAD_NO_TYPEOF_PATCH, 0, &binding);
+	if (new_module == 0)
+		return false;
+
+	ReloadState reload;
+	reload.module = this;
+	reload.arena = &new_module->arena;
+	reload.hierarchy_changed = false;
+
+	// Update existing types in place first so that added types can be remapped against them
+	std::vector<Type*> added_types;
+	const TypeIndex& new_types = new_module->types;
+	for (size_t i = 0; i < new_types.entries.size(); i++)
+	{
+		Type* new_type = new_types.entries[i].type;
+		if (new_type == 0)
+			continue;
+
+		if (Type* type = types.Find(new_types.entries[i].hash_id))
+			UpdateType(reload, *type, *new_type);
+		else
+			added_types.push_back(new_type);
+	}
+
+	for (size_t i = 0; i < added_types.size(); i++)
+		types.Add(added_types[i]->full_name.hash_id, added_types[i]);
+	for (size_t i = 0; i < added_types.size(); i++)
+		AddType(reload, *added_types[i]);
+
+	// Derived classes store their ancestors so have to be rebuilt along with any changed base classes
+	if (reload.hierarchy_changed)
+	{
+		for (size_t i = 0; i < reload.classes.size(); i++)
+			reload.classes[i]->hierarchy = 0;
+		for (size_t i = 0; i < reload.classes.size(); i++)
+			reload.classes[i]->BuildHierarchy(*reload.arena);
+	}
+
+	// The perfect hash only covers the types it was built with
+	if (!added_types.empty())
+		type_hash.Build(*reload.arena, types);
+
+	// Updated and added types are all in the type index by now
+	UpdateTypeOfPointers(*this);
+
+	// Changed functions and fields change the traits of their type and any type that contains it
+	BuildTypeTraits();
+
+	// Pick up any strings that are new to the module
+	const NamePool& new_names = new_module->names;
+	for (size_t i = 0; i < new_names.entries.size(); i++)
+	{
+		if (new_names.entries[i].string)
+			names.Add(new_names.entries[i].hash_id, new_names.entries[i].string);
+	}
+
+	// Replaced data lives in the new module's arena, which is kept while the rest of the module is
+	// discarded. Its top-level scopes are parented to the new module's global namespace, which goes
+	// with it, so they're moved under this module's global namespace instead.
+	RemapFunctions(*this, new_module->global_namespace);
+	AdoptChildren(*this, new_module->global_namespace.children, &global_namespace);
+	arena.Adopt(new_module->arena);
+	delete new_module;
+
+	return true;
+}
@@ -0,0 +1,101 @@
+
+#include "RflSharedModule.h"
+#include "Win32.h"
+
+using namespace rfl;
+
+
+SharedModule::SharedModule()
+	: current(0)
+	, epoch(1)
+{
+	for (u32 i = 0; i < MAX_READERS; i++)
+		reader_epochs[i] = 0;
+}
+
+
+SharedModule::~SharedModule()
+{
+	// Retire the current module like any other and wait for the readers to drain
+	Publish(0);
+	while (Reclaim())
+		Win32::YieldThread();
+}
+
+
+bool SharedModule::Publish(Module* module)
+{
+	// Readers can't materialise types safely
+	if (module && module->lazy_loader)
+		return false;
+
+	// Readers that see the new epoch are guaranteed to see the new module as the exchange comes first
+	Module* old_module = (Module*)Win32::AtomicExchangePointer((void* volatile&)current, module);
+	if (module)
+		UpdateTypeOfPointers(*module);
+
+	if (old_module)
+	{
+		RetiredModule retired_module = { old_module, Win32::AtomicIncrement(epoch) };
+		retired.push_back(retired_module);
+	}
+
+	Reclaim();
+	return true;
+}
+
+
+u32 SharedModule::Reclaim()
+{
+	// Find the oldest epoch a reader is still in
+	u32 oldest_epoch = 0xFFFFFFFF;
+	for (u32 i = 0; i < MAX_READERS; i++)
+	{
+		u32 reader_epoch = reader_epochs[i];
+		if (reader_epoch && reader_epoch < oldest_epoch)
+			oldest_epoch = reader_epoch;
+	}
+
+	// Retired modules are in epoch order, so stop at the first one that may still be in use
+	size_t nb_reclaimed = 0;
+	while (nb_reclaimed < retired.size() && retired[nb_reclaimed].epoch <= oldest_epoch)
+	{
+		// TypeOf pointers already point at newer modules so are left alone
+		UnloadModule(retired[nb_reclaimed].module);
+		nb_reclaimed++;
+	}
+
+	retired.erase(retired.begin(), retired.begin() + nb_reclaimed);
+	return (u32)retired.size();
+}
+
+
+const Module* SharedModule::Enter(u32& slot)
+{
+	// Threads have stacks of their own so start searching at a different slot on each
+	u32 index = u32(size_t(&slot) >> 12) % MAX_READERS;
+
+	// Claim a free slot by recording the epoch the reader is entering in. The epoch may have moved on
+	// by the time the slot is claimed, which only delays reclamation.
+	for (u32 nb_tries = 1; ; nb_tries++)
+	{
+		u32 entry_epoch = epoch;
+		if (reader_epochs[index] == 0 && Win32::AtomicCompareExchange(reader_epochs[index], entry_epoch, 0) == 0)
+			break;
+
+		index = (index + 1) % MAX_READERS;
+		if (nb_tries % MAX_READERS == 0)
+			Win32::YieldThread();
+	}
+
+	// The exchange above is a full barrier so the module is read after the slot is visible to Reclaim
+	slot = index;
+	return current;
+}
+
+
+void SharedModule::Leave(u32 slot)
+{
+	// Volatile writes have release semantics so every read of the module happens before this
+	reader_epochs[slot] = 0;
+}
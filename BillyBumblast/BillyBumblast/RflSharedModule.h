@@ -0,0 +1,91 @@
+
+#pragma once
+
+#include "Rfl.h"
+
+
+namespace rfl
+{
+	//
+	// Shares a module between any number of reader threads (e.g. serialisation jobs) and one thread
+	// that replaces it with newly loaded versions, without readers ever taking a lock.
+	//
+	// Published modules are frozen: they must be fully loaded, rather than lazily loaded, and can't be
+	// changed with Module::Reload. Instead, a new version is loaded with LOAD_NO_TYPEOF_PATCH and
+	// published in its place. Readers enter an epoch for as long as they use the module, and replaced
+	// modules are only unloaded once every reader that could have seen them has left.
+	//
+	// TypeOf pointers are patched to the newest module as it's published, so a reader that spans a
+	// publish can see types from both versions. Both stay loaded until the reader leaves.
+	//
+	struct SharedModule
+	{
+		// Readers that can be inside the module at once, with any more waiting for a free slot
+		enum { MAX_READERS = 64 };
+
+		SharedModule();
+
+		// Waits for all readers to leave before unloading every module
+		~SharedModule();
+
+		// Make the module current, retiring the previous one. Returns false, leaving the current module
+		// in place, if the module is lazily loaded. Only one thread can publish at a time.
+		bool Publish(Module* module);
+
+		// Unload retired modules that no reader can still be using, returning the number left. Called
+		// on every publish, and by the publishing thread at any other time.
+		u32 Reclaim();
+
+		// Use SharedModuleReader instead of calling these directly. Enter returns the current module,
+		// which stays loaded until Leave is called with the same slot.
+		const Module* Enter(u32& slot);
+		void Leave(u32 slot);
+
+		Module* volatile current;
+
+		// Incremented every time a module is retired
+		volatile u32 epoch;
+
+		// The epoch each reader entered in, or zero for slots that are free
+		volatile u32 reader_epochs[MAX_READERS];
+
+		struct RetiredModule
+		{
+			Module* module;
+
+			// Readers that entered in this epoch or later can't have seen the module
+			u32 epoch;
+		};
+
+		// Only used by the publishing thread
+		std::vector<RetiredModule> retired;
+	};
+
+
+	//
+	// Keeps the current module of a shared module loaded while in scope
+	//
+	struct SharedModuleReader
+	{
+		SharedModuleReader(SharedModule& shared) : shared(shared)
+		{
+			module = shared.Enter(slot);
+		}
+
+		~SharedModuleReader()
+		{
+			shared.Leave(slot);
+		}
+
+		SharedModule& shared;
+
+		// Null if nothing has been published yet
+		const Module* module;
+
+		u32 slot;
+
+	private:
+		SharedModuleReader(const SharedModuleReader&);
+		SharedModuleReader& operator = (const SharedModuleReader&);
+	};
+}
@@ -1,438 +1,1230 @@
-
 #include "RflXmlDbReader.h"
 #include "Rfl.h"
 #include "Win32.h"
-#include "tinyxml.h"
 
 using namespace rfl;
 
 
 namespace
 {
-	typedef std::map<u32, Type*> TypeMap;
+	//
+	// A minimal pull parser that reads elements straight out of the mapped XML file, so that the
+	// reflection objects can be built as the file is scanned without an intermediate document
+	//
+	struct XmlReader
+	{
+		const char* pos;
+		const char* end;
+
+		// The most recently read start tag
+		const char* tag;
+		size_t tag_length;
+		const char* attributes;
+		const char* attributes_end;
+
+		// Set when the last start tag was self-closing, so that its children can be iterated
+		// in the same way as those of any other element
+		bool pending_end;
+
+		bool error;
+	};
+
+
+	// Reference to a run of text in the file, which is not null-terminated
+	struct XmlText
+	{
+		const char* text;
+		size_t length;
+	};
+
+
+	// Number of entries in a collection element, recorded ahead of the main parse
+	struct CollectionCount
+	{
+		// Start of the collection's tag name, uniquely identifying it within the file
+		const char* tag;
+
+		u32 count;
+	};
+
+
+	// A type pointer that can't be resolved until every type in the database has been added to the index
+	struct TypeFixup
+	{
+		const Type** type_ptr;
+		u32 hash_id;
+	};
+
+
+	// The types describing each kind of scope, whose name hashes are computed once per parser
+	enum MetaType
+	{
+		META_NAMESPACE,
+		META_BASE_TYPE,
+		META_CLASS,
+		META_TEMPLATE,
+		META_TEMPLATE_INSTANCE,
+		META_ENUM,
+		NB_META_TYPES
+	};
+
+
+	// A namespace left for a worker thread to parse, starting just after its start tag
+	struct NamespaceJob
+	{
+		XmlReader reader;
+		Namespace* ns;
+		Scope* parent_scope;
+	};
+
+
+	struct XmlDbParser : public XmlReader
+	{
+		// Collection sizes in document order, shared between all parsers of the file, with the index
+		// of the next one to be parsed
+		std::vector<CollectionCount>* counts;
+		size_t next_count;
+
+		// Total number of types in the file
+		u32 nb_types;
+
+		// Module being loaded, which owns all created objects
+		const Module* module;
+		Arena* arena;
+		TypeIndex* type_index;
+
+		std::vector<TypeFixup> fixups;
+
+		// Classes that need their field tables building once type references have been resolved
+		std::vector<Class*> classes;
+
+		// Strings are looked up in the module's pool, which is read-only while workers are running,
+		// with any that are missing added to the new names pool
+		const NamePool* names;
+		NamePool* new_names;
+		bool load_names;
+
+		// Reused for decoding each name string before it's copied to the arena
+		std::string text;
+
+		u32 meta_type_hashes[NB_META_TYPES];
+
+		// When set, the child namespaces of this scope are recorded as jobs instead of being parsed
+		Scope* deferred_scope;
+		std::vector<NamespaceJob>* jobs;
+	};
+
+
+	// Parser state for each thread, owning everything it creates until it's merged into the module
+	struct NamespaceWorker
+	{
+		XmlDbParser parser;
+		Arena arena;
+		TypeIndex types;
+		NamePool names;
+	};
+
+
+	struct ParallelParse
+	{
+		std::vector<NamespaceJob>* jobs;
+		std::vector<NamespaceWorker>* workers;
+	};
+
+
+	void ParseNamespace(XmlDbParser& parser, Namespace& ns, Scope* parent_scope);
+	void ParseBaseType(XmlDbParser& parser, BaseType& type, Scope* parent_scope);
+	void ParseClass(XmlDbParser& parser, Class& cls, Scope* parent_scope);
+	void ParseTemplate(XmlDbParser& parser, Template& templ, Scope* parent_scope);
+	void ParseTemplateInstance(XmlDbParser& parser, TemplateInstance& instance, Scope* parent_scope);
+	void ParseFunction(XmlDbParser& parser, Function& function, Scope*);
+	void ParseEnum(XmlDbParser& parser, Enum& enm, Scope* parent_scope);
+
+
+	bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+
+	const char* FindChar(const char* pos, const char* end, char c)
+	{
+		while (pos != end && *pos != c)
+			pos++;
+		return pos;
+	}
+
+
+	const char* SkipPast(const char* pos, const char* end, const char* str)
+	{
+		size_t length = strlen(str);
+		while (size_t(end - pos) >= length && memcmp(pos, str, length))
+			pos++;
+		return size_t(end - pos) >= length ? pos + length : end;
+	}
+
+
+	bool StartsWith(const char* pos, const char* end, const char* str)
+	{
+		size_t length = strlen(str);
+		return size_t(end - pos) >= length && !memcmp(pos, str, length);
+	}
+
+
+	void InitReader(XmlReader& reader, const char* data, u32 size)
+	{
+		reader.pos = data;
+		reader.end = data + size;
+		reader.tag = 0;
+		reader.tag_length = 0;
+		reader.attributes = 0;
+		reader.attributes_end = 0;
+		reader.pending_end = false;
+		reader.error = false;
+	}
+
+
+	bool ReadChildElement(XmlReader& reader)
+	{
+		// A self-closing element has no children
+		if (reader.pending_end)
+		{
+			reader.pending_end = false;
+			return false;
+		}
+
+		while (true)
+		{
+			// Step over any text content until the next tag
+			const char* end = reader.end;
+			const char* pos = FindChar(reader.pos, end, '<');
+			if (pos == end)
+			{
+				// Running out of file before the parent element is closed is an error
+				reader.pos = end;
+				reader.error = true;
+				return false;
+			}
+
+			// Skip comments, processing instructions and declarations
+			if (StartsWith(pos, end, "<!--"))
+			{
+				reader.pos = SkipPast(pos, end, "-->");
+				continue;
+			}
+			if (StartsWith(pos, end, "<?"))
+			{
+				reader.pos = SkipPast(pos, end, "?>");
+				continue;
+			}
+			if (StartsWith(pos, end, "<!"))
+			{
+				reader.pos = SkipPast(pos, end, ">");
+				continue;
+			}
+
+			// The end tag of the parent element
+			if (StartsWith(pos, end, "</"))
+			{
+				reader.pos = SkipPast(pos, end, ">");
+				return false;
+			}
+
+			// Read the tag name
+			const char* tag = ++pos;
+			while (pos != end && !IsSpace(*pos) && *pos != '/' && *pos != '>')
+				pos++;
+			reader.tag = tag;
+			reader.tag_length = pos - tag;
+			reader.attributes = pos;
+
+			// Find the end of the start tag, stepping over quoted attribute values
+			char quote = 0;
+			while (pos != end && (quote || *pos != '>'))
+			{
+				if (quote == 0 && (*pos == '"' || *pos == '\''))
+					quote = *pos;
+				else if (quote == *pos)
+					quote = 0;
+				pos++;
+			}
+			if (pos == end)
+			{
+				reader.pos = end;
+				reader.error = true;
+				return false;
+			}
+
+			reader.attributes_end = pos;
+			reader.pending_end = pos[-1] == '/';
+			reader.pos = pos + 1;
+			return true;
+		}
+	}
+
+
+	void SkipElement(XmlReader& reader)
+	{
+		while (ReadChildElement(reader))
+			SkipElement(reader);
+	}
+
+
+	bool IsElement(const XmlReader& reader, const char* element_name)
+	{
+		size_t length = strlen(element_name);
+		return reader.tag_length == length && !memcmp(reader.tag, element_name, length);
+	}
+
+
+	XmlText ReadElementText(XmlReader& reader)
+	{
+		XmlText text = { reader.pos, 0 };
+		if (reader.pending_end)
+		{
+			reader.pending_end = false;
+			return text;
+		}
+
+		// Trim whitespace from both ends of the text before the next tag
+		const char* start = reader.pos;
+		const char* end = FindChar(start, reader.end, '<');
+		reader.pos = end;
+		while (start != end && IsSpace(*start))
+			start++;
+		while (end != start && IsSpace(end[-1]))
+			end--;
+		text.text = start;
+		text.length = end - start;
+
+		// Step over any unexpected children and the end tag
+		while (ReadChildElement(reader))
+			SkipElement(reader);
+
+		return text;
+	}
+
+
+	void DecodeText(const char* pos, const char* end, std::string& str)
+	{
+		str.clear();
+		str.reserve(end - pos);
+
+		while (pos != end)
+		{
+			if (*pos != '&')
+			{
+				str += *pos++;
+				continue;
+			}
+
+			// Decode the entity, leaving it as-is if it's not recognised
+			const char* semicolon = FindChar(pos, end, ';');
+			if (semicolon == end)
+			{
+				str.append(pos, end);
+				return;
+			}
+
+			std::string entity(pos + 1, semicolon);
+			if (entity == "lt")
+				str += '<';
+			else if (entity == "gt")
+				str += '>';
+			else if (entity == "amp")
+				str += '&';
+			else if (entity == "quot")
+				str += '"';
+			else if (entity == "apos")
+				str += '\'';
+			else if (entity.size() > 2 && entity[0] == '#' && entity[1] == 'x')
+				str += (char)strtol(entity.c_str() + 2, 0, 16);
+			else if (entity.size() > 1 && entity[0] == '#')
+				str += (char)strtol(entity.c_str() + 1, 0, 10);
+			else
+				str.append(pos, semicolon + 1);
+
+			pos = semicolon + 1;
+		}
+	}
+
 
+	bool ReadAttribute(const XmlReader& reader, const char* attribute_name, std::string& value)
+	{
+		size_t length = strlen(attribute_name);
+		const char* pos = reader.attributes;
+		const char* end = reader.attributes_end;
 
-	void ParseNamespace(TiXmlNode* node, Namespace& ns, Scope* parent_scope);
-	void ParseBaseType(TiXmlNode* node, BaseType& type, Scope* parent_scope);
-	void ParseClass(TiXmlNode* node, Class& cls, Scope* parent_scope);
-	void ParseTemplate(TiXmlNode* node, Template& templ, Scope* parent_scope);
-	void ParseTemplateInstance(TiXmlNode* node, TemplateInstance& instance, Scope* parent_scope);
-	void ParseFunction(TiXmlNode* node, Function& function, Scope*);
-	void ParseEnum(TiXmlNode* node, Enum& enm, Scope* parent_scope);
-	void PopulateTypeMapScope(TypeMap& type_map, Scope& scope);
-	void PatchTypePointersScope(TypeMap& type_map, Scope& scope);
+		while (true)
+		{
+			// Read the next attribute name
+			while (pos != end && IsSpace(*pos))
+				pos++;
+			const char* name = pos;
+			while (pos != end && *pos != '=' && !IsSpace(*pos))
+				pos++;
+			size_t name_length = pos - name;
+
+			// Find the quoted value
+			while (pos != end && *pos != '"' && *pos != '\'')
+				pos++;
+			if (pos == end)
+				return false;
+			char quote = *pos++;
+			const char* value_start = pos;
+			pos = FindChar(pos, end, quote);
+			if (pos == end)
+				return false;
+
+			if (name_length == length && !memcmp(name, attribute_name, length))
+			{
+				DecodeText(value_start, pos, value);
+				return true;
+			}
+
+			pos++;
+		}
+	}
 
 
-	TiXmlElement* GetElement(TiXmlNode* node, const char* element_name)
+	__int64 ParseInt64(const XmlText& text)
 	{
-		// Get the first child as an element
-		TiXmlNode* element_node = node->FirstChild(element_name);
-		if (element_node)
-			return element_node->ToElement();
+		const char* pos = text.text;
+		const char* end = text.text + text.length;
+
+		bool negative = pos != end && *pos == '-';
+		if (negative)
+			pos++;
+
+		__int64 value = 0;
+		while (pos != end && *pos >= '0' && *pos <= '9')
+			value = value * 10 + (*pos++ - '0');
+
+		return negative ? -value : value;
+	}
+
+
+	bool TextEquals(const XmlText& text, const char* str)
+	{
+		return text.length == strlen(str) && !_strnicmp(text.text, str, text.length);
+	}
+
+
+	struct CollectionInfo
+	{
+		const char* name;
+		const char* entry_name;
+
+		// Set if each entry is a type that gets added to the module's type index
+		bool is_type;
+	};
+
+
+	const CollectionInfo* GetCollectionInfo(const XmlReader& reader)
+	{
+		static const CollectionInfo collections[] =
+		{
+			{ "Names", "Name", false },
+			{ "Namespaces", "Namespace", false },
+			{ "BaseTypes", "BaseType", true },
+			{ "Classes", "Class", true },
+			{ "Templates", "Template", true },
+			{ "TemplateInstances", "TemplateInstance", true },
+			{ "Enums", "Enum", true },
+			{ "Functions", "Function", false },
+			{ "BaseClasses", "BaseClass", false },
+			{ "Fields", "Field", false },
+			{ "Parameters", "Parameter", false },
+			{ "Entries", "Entry", false },
+		};
+
+		for (size_t i = 0; i < sizeof(collections) / sizeof(collections[0]); i++)
+		{
+			if (IsElement(reader, collections[i].name))
+				return &collections[i];
+		}
 
 		return 0;
 	}
 
 
-	void ParseName(TiXmlNode* node, const char* element_name, Name& name)
+	// The first pass over the file records the number of entries in every collection element, in the
+	// order they appear, along with the total number of types. No objects are created.
+	void CountCollections(XmlDbParser& parser)
 	{
-		TiXmlNode* element_node = node->FirstChild(element_name);
-		if (element_node)
+		while (ReadChildElement(parser))
 		{
-			TiXmlElement* element = element_node->ToElement();
-			name.string = element->Attribute("str");
-			name.hash_id = (u32)_atoi64(element->GetText());		// Hash id is 32-bits unsigned, which is out of the range of atoi
+			if (const CollectionInfo* info = GetCollectionInfo(parser))
+			{
+				std::vector<CollectionCount>& counts = *parser.counts;
+				size_t index = counts.size();
+				CollectionCount count = { parser.tag, 0 };
+				counts.push_back(count);
+
+				while (ReadChildElement(parser))
+				{
+					if (IsElement(parser, info->entry_name))
+						counts[index].count++;
+					CountCollections(parser);
+				}
+
+				if (info->is_type)
+					parser.nb_types += counts[index].count;
+			}
+			else
+			{
+				CountCollections(parser);
+			}
 		}
 	}
 
 
-	const char* ParseText(TiXmlNode* node, const char* element_name)
+	u32 GetCollectionCount(XmlDbParser& parser)
 	{
-		if (TiXmlElement* element = GetElement(node, element_name))
-			return element->GetText();
+		// Collections are parsed in document order, passing over the counts of any that are skipped
+		std::vector<CollectionCount>& counts = *parser.counts;
+		while (parser.next_count < counts.size() && counts[parser.next_count].tag < parser.tag)
+			parser.next_count++;
+
+		if (parser.next_count < counts.size() && counts[parser.next_count].tag == parser.tag)
+			return counts[parser.next_count++].count;
 
 		return 0;
 	}
 
 
-	template <typename TYPE> void ParseInteger(TiXmlNode* node, const char* element_name, TYPE& value)
+	size_t FindFirstCollectionCount(const std::vector<CollectionCount>& counts, const char* pos)
+	{
+		// Binary search for the first collection at or after the given position in the file
+		size_t first = 0;
+		size_t last = counts.size();
+		while (first < last)
+		{
+			size_t mid = first + (last - first) / 2;
+			if (counts[mid].tag < pos)
+				first = mid + 1;
+			else
+				last = mid;
+		}
+
+		return first;
+	}
+
+
+	u32 ParseHashID(XmlDbParser& parser)
 	{
-		if (TiXmlElement* element = GetElement(node, element_name))
-			value = TYPE(_atoi64(element->GetText()));
+		return (u32)ParseInt64(ReadElementText(parser));		// Hash id is 32-bits unsigned, which is out of the range of atoi
 	}
 
 
-	bool ParseBool(TiXmlNode* node, const char* element_name)
+	const char* AddNameString(XmlDbParser& parser, NamePool& pool, const XmlReader& start_tag, u32 hash_id)
 	{
-		if (TiXmlElement* element = GetElement(node, element_name))
+		if (!ReadAttribute(start_tag, "str", parser.text))
+			return 0;
+
+		const char* string = parser.arena->AllocString(parser.text.c_str(), parser.text.size());
+		pool.Add(hash_id, string);
+		return string;
+	}
+
+
+	const char* PoolNameString(XmlDbParser& parser, const XmlReader& start_tag, u32 hash_id)
+	{
+		if (!parser.load_names)
+			return 0;
+
+		const char* string = parser.names->Find(hash_id);
+		if (string == 0 && parser.new_names != parser.names)
+			string = parser.new_names->Find(hash_id);
+		if (string == 0)
+			string = AddNameString(parser, *parser.new_names, start_tag, hash_id);
+		return string;
+	}
+
+
+	void ParseName(XmlDbParser& parser, Name& name)
+	{
+		// Keep the start tag around so that its string only needs decoding if it's not already pooled
+		XmlReader start_tag = parser;
+		name.hash_id = ParseHashID(parser);
+
+		const char* string = PoolNameString(parser, start_tag, name.hash_id);
+#if RFL_NAME_STRINGS
+		name.string = string;
+#else
+		(void)string;
+#endif
+	}
+
+
+	void ParseNames(XmlDbParser& parser, NamePool& pool)
+	{
+		// Populate the pool from the table at the start of the file, before any other names are read
+		pool.Reserve(GetCollectionCount(parser));
+		while (ReadChildElement(parser))
 		{
-			const char* text = element->GetText();
-			return !_stricmp(text, "true");
+			if (IsElement(parser, "Name"))
+			{
+				XmlReader start_tag = parser;
+				u32 hash_id = ParseHashID(parser);
+				if (pool.Find(hash_id) == 0)
+					AddNameString(parser, pool, start_tag, hash_id);
+			}
+			else
+			{
+				SkipElement(parser);
+			}
 		}
+	}
+
+
+	template <typename TYPE> void ParseInteger(XmlDbParser& parser, TYPE& value)
+	{
+		value = TYPE(ParseInt64(ReadElementText(parser)));
+	}
 
-		return false;
+
+	bool ParseBool(XmlDbParser& parser)
+	{
+		return TextEquals(ReadElementText(parser), "true");
 	}
 
 
 	template <typename TYPE> void ParseCollection(
-		TiXmlNode* root_node,
-		std::vector<TYPE>& collection,
+		XmlDbParser& parser,
+		Array<TYPE>& collection,
 		Scope* parent_scope,
-		const char* collection_name,
 		const char* entry_name,
-		void (*parse_func)(TiXmlNode*, TYPE&, Scope*))
+		void (*parse_func)(XmlDbParser&, TYPE&, Scope*))
 	{
-		// Search for the collection
-		if (TiXmlNode* node = root_node->FirstChild(collection_name))
+		// Construct every object up-front so that their addresses don't change while the rest of
+		// the file is parsed
+		u32 count = GetCollectionCount(parser);
+		collection.Allocate(*parser.arena, count);
+
+		// Iterate over every entry
+		u32 index = 0;
+		while (ReadChildElement(parser))
 		{
-			// Iterate over every entry
-			TiXmlNode* child_node = node->FirstChild(entry_name);
-			while (child_node)
-			{
-				// Allocate a new object in the array and parse it
-				collection.push_back(TYPE());
-				TYPE& object = collection.back();
-				parse_func(child_node, object, parent_scope);
+			if (index < count && IsElement(parser, entry_name))
+				parse_func(parser, collection[index++], parent_scope);
+			else
+				SkipElement(parser);
+		}
+	}
 
-				child_node = child_node->NextSibling(entry_name);
-			}
+
+	// Objects are parsed by handing each of their child elements to an element parser, which returns
+	// false for any element it doesn't recognise so that it can be skipped.
+	template <typename TYPE> void ParseElements(
+		XmlDbParser& parser,
+		TYPE& object,
+		Scope* parent_scope,
+		bool (*parse_element_func)(XmlDbParser&, TYPE&, Scope*))
+	{
+		while (ReadChildElement(parser))
+		{
+			if (!parse_element_func(parser, object, parent_scope))
+				SkipElement(parser);
 		}
 	}
 
 
+	void AddFixup(XmlDbParser& parser, const Type*& type_ptr, u32 hash_id)
+	{
+		type_ptr = 0;
+		TypeFixup fixup = { &type_ptr, hash_id };
+		parser.fixups.push_back(fixup);
+	}
+
 
+	void ParseType(XmlDbParser& parser, const Type*& type_ptr)
+	{
+		// Record the type reference for patching after the parse, which only needs the hash
+		AddFixup(parser, type_ptr, ParseHashID(parser));
+	}
 
 
-	Type* MakePatchableTypePtr(const char* type_name)
+	void SetMetaType(XmlDbParser& parser, Scope& scope, MetaType meta_type)
 	{
-		u32 hash_id = Name(type_name).hash_id;
-		return (Type*)(u64)hash_id;
+		AddFixup(parser, scope.type, parser.meta_type_hashes[meta_type]);
 	}
 
 
-	Type* ParseType(TiXmlNode* node, const char* name)
+	void ResolveFunctionPtr(const Function*& function, const Type& type)
 	{
-		// Temporarily store the hash ID in the type pointer, to be patched later
-		Name type_name;
-		ParseName(node, name, type_name);
-		return (Type*)(u64)type_name.hash_id;
+		// The function index is temporarily stored in the pointer, with -1 meaning there's no function
+		int index = (int&)function;
+		if (index < 0 || index >= (int)type.functions().size())
+			function = 0;
+		else
+			function = &type.functions()[index];
 	}
 
 
-	void ParseParameter(TiXmlNode* node, Parameter& param, Scope* parent_scope)
+	void AddType(XmlDbParser& parser, Type& type)
 	{
-		ParseName(node, "Name", param.name);
-		param.type = ParseType(node, "Type");
-		param.is_const = ParseBool(node, "IsConst");
+		// Types are never moved once constructed so they can be indexed and have their function
+		// pointers resolved as soon as they're parsed
+		parser.type_index->Add(type.full_name.hash_id, &type);
+
+		ResolveFunctionPtr(type.constructor, type);
+		ResolveFunctionPtr(type.destructor, type);
+		ResolveFunctionPtr(type.copy_constructor, type);
+		ResolveFunctionPtr(type.assignment_operator, type);
+	}
+
+
+	bool ParseParameterElement(XmlDbParser& parser, Parameter& param, Scope* parent_scope)
+	{
+		if (IsElement(parser, "Name"))
+			ParseName(parser, param.name);
+		else if (IsElement(parser, "Type"))
+			ParseType(parser, param.type);
+		else if (IsElement(parser, "IsConst"))
+			param.is_const = ParseBool(parser);
 
 		// Manual bit-field assignment for the array info
-		if (TiXmlElement* element = GetElement(node, "ArrayRank"))
-			param.array_rank = int(_atoi64(element->GetText()));
-		if (TiXmlElement* element = GetElement(node, "ArrayLength0"))
-			param.array_length_0 = int(_atoi64(element->GetText()));
-		if (TiXmlElement* element = GetElement(node, "ArrayLength1"))
-			param.array_length_1 = int(_atoi64(element->GetText()));
+		else if (IsElement(parser, "ArrayRank"))
+			param.array_rank = int(ParseInt64(ReadElementText(parser)));
+		else if (IsElement(parser, "ArrayLength0"))
+			param.array_length_0 = int(ParseInt64(ReadElementText(parser)));
+		else if (IsElement(parser, "ArrayLength1"))
+			param.array_length_1 = int(ParseInt64(ReadElementText(parser)));
 
 		// Map the modifier enumeration
-		if (const char* modifier = ParseText(node ,"Modifier"))
+		else if (IsElement(parser, "Modifier"))
 		{
-			if (!_stricmp(modifier, "value"))
+			XmlText modifier = ReadElementText(parser);
+			if (TextEquals(modifier, "value"))
 				param.modifier = Parameter::VALUE;
-			else if (!_stricmp(modifier, "pointer"))
+			else if (TextEquals(modifier, "pointer"))
 				param.modifier = Parameter::POINTER;
-			else if (!_stricmp(modifier, "reference"))
+			else if (TextEquals(modifier, "reference"))
 				param.modifier = Parameter::REFERENCE;
 		}
+
+		else
+			return false;
+
+		return true;
 	}
 
 
-	void ParseField(TiXmlNode* node, Field& field, Scope* parent_scope)
+	void ParseParameter(XmlDbParser& parser, Parameter& param, Scope* parent_scope)
 	{
-		ParseParameter(node, field, parent_scope);
-
-		ParseInteger(node, "Offset", field.offset);
+		ParseElements(parser, param, parent_scope, ParseParameterElement);
 	}
 
 
-	void ParseFunction(TiXmlNode* node, Function& function, Scope*)
+	bool ParseFieldElement(XmlDbParser& parser, Field& field, Scope* parent_scope)
 	{
-		ParseName(node, "Name", function.name);
-		ParseInteger(node, "CallAddress", function.call_address);
+		if (IsElement(parser, "Offset"))
+		{
+			ParseInteger(parser, field.offset);
+			return true;
+		}
 
-		// Functions could inherit from Scope, making the Scope parameter mean something here
-		// Note that functions can also introduce new types, enums, etc.
+		return ParseParameterElement(parser, field, parent_scope);
+	}
 
-		if (TiXmlNode* param_node = node->FirstChild("ReturnParameter"))
-			ParseParameter(param_node, function.return_parameter, 0);
 
-		ParseCollection<Parameter>(node, function.parameters, 0, "Parameters", "Parameter", ParseParameter);
+	void ParseField(XmlDbParser& parser, Field& field, Scope* parent_scope)
+	{
+		ParseElements(parser, field, parent_scope, ParseFieldElement);
 	}
 
 
-	void ParseScope(TiXmlNode* node, Scope& scope, Scope* parent_scope)
+	bool ParseBaseClassElement(XmlDbParser& parser, Class::BaseClass& base, Scope*)
 	{
-		scope.parent_scope = parent_scope;
-		ParseName(node, "Name", scope.name);
-		ParseName(node, "FullName", scope.full_name);
+		if (IsElement(parser, "Type"))
+			ParseType(parser, base.type);
+		else if (IsElement(parser, "Offset"))
+			ParseInteger(parser, base.offset);
+		else
+			return false;
 
-		ParseCollection<Namespace>(node, scope.namespaces, &scope, "Namespaces", "Namespace", ParseNamespace);
-		ParseCollection<BaseType>(node, scope.base_types, &scope, "BaseTypes", "BaseType", ParseBaseType);
-		ParseCollection<Class>(node, scope.classes, &scope, "Classes", "Class", ParseClass);
-		ParseCollection<Template>(node, scope.templates, &scope, "Templates", "Template", ParseTemplate);
-		ParseCollection<TemplateInstance>(node, scope.template_instances, &scope, "TemplateInstances", "TemplateInstance", ParseTemplateInstance);
-		ParseCollection<Enum>(node, scope.enums, &scope, "Enums", "Enum", ParseEnum);
-		ParseCollection<Function>(node, scope.functions, &scope, "Functions", "Function", ParseFunction);
+		return true;
 	}
 
 
-	void ParseNamespace(TiXmlNode* node, Namespace& ns, Scope* parent_scope)
+	void ParseBaseClass(XmlDbParser& parser, Class::BaseClass& base, Scope* parent_scope)
 	{
-		ns.type = MakePatchableTypePtr("rfl::Namespace");
-		ParseScope(node, ns, parent_scope);
+		ParseElements(parser, base, parent_scope, ParseBaseClassElement);
 	}
 
 
-	void ParseType(TiXmlNode* node, Type& type, Scope* parent_scope)
+	bool ParseFunctionElement(XmlDbParser& parser, Function& function, Scope*)
 	{
-		ParseInteger(node, "UniqueID", type.unique_id);
-		ParseInteger(node, "Size", type.size);
-		ParseInteger(node, "TypeOfVA", type.typeof_va);
+		// Functions could inherit from Scope, making the Scope parameter mean something here
+		// Note that functions can also introduce new types, enums, etc.
 
-		ParseScope(node, type, parent_scope);
+		if (IsElement(parser, "Name"))
+			ParseName(parser, function.name);
+		else if (IsElement(parser, "CallAddress"))
+			ParseInteger(parser, function.call_address);
+		else if (IsElement(parser, "ReturnParameter"))
+			ParseParameter(parser, function.return_parameter, 0);
+		else if (IsElement(parser, "Parameters"))
+			ParseCollection<Parameter>(parser, function.parameters, 0, "Parameter", ParseParameter);
+		else
+			return false;
 
-		// After the scope has collected the functions
-		ParseInteger(node, "ConstructorIndex", type.constructor);
-		ParseInteger(node, "DestructorIndex", type.destructor);
-		ParseInteger(node, "CopyConstructorIndex", type.copy_constructor);
-		ParseInteger(node, "AssignmentOperatorIndex", type.assignment_operator);
+		return true;
 	}
 
 
-	void ParseBaseType(TiXmlNode* node, BaseType& type, Scope* parent_scope)
+	void ParseFunction(XmlDbParser& parser, Function& function, Scope* parent_scope)
 	{
-		type.type = MakePatchableTypePtr("rfl::BaseType");
-		ParseType(node, type, parent_scope);
+		function.module = parser.module;
+		ParseElements(parser, function, parent_scope, ParseFunctionElement);
 	}
 
 
-	void ParseClass(TiXmlNode* node, Class& cls, Scope* parent_scope)
+	ScopeChildren& AllocChildren(XmlDbParser& parser, Scope& scope)
 	{
-		cls.type = MakePatchableTypePtr("rfl::Class");
-		cls.is_pod = ParseBool(node, "IsPOD");
-
-		ParseCollection<Field>(node, cls.fields, &cls, "Fields", "Field", ParseField);
-
-		ParseType(node, cls, parent_scope);
+		// Scopes only get children once the first of their collections is found
+		return scope.AllocChildren(*parser.arena);
 	}
 
 
-	void ParseTemplate(TiXmlNode* node, Template& templ, Scope* parent_scope)
+	void DeferNamespaces(XmlDbParser& parser, Scope& scope)
 	{
-		templ.type = MakePatchableTypePtr("rfl::Template");
-		ParseType(node, templ, parent_scope);
+		// The namespaces are allocated up-front so that workers can parse into them in any order
+		u32 count = GetCollectionCount(parser);
+		Array<Namespace>& namespaces = AllocChildren(parser, scope).namespaces;
+		namespaces.Allocate(*parser.arena, count);
+
+		// Record where each namespace starts and step over it
+		u32 index = 0;
+		while (ReadChildElement(parser))
+		{
+			if (index < count && IsElement(parser, "Namespace"))
+			{
+				NamespaceJob job;
+				job.reader = parser;
+				job.ns = &namespaces[index++];
+				job.parent_scope = &scope;
+				parser.jobs->push_back(job);
+			}
+
+			SkipElement(parser);
+		}
 	}
 
 
-	void ParseTemplateInstance(TiXmlNode* node, TemplateInstance& instance, Scope* parent_scope)
+	bool ParseScopeElement(XmlDbParser& parser, Scope& scope)
 	{
-		instance.type = MakePatchableTypePtr("rfl::TemplateInstance");
-		instance.instance_of = (Template*)ParseType(node, "InstanceOf");
-		instance.type0 = ParseType(node, "Type0");
-		instance.type1 = ParseType(node, "Type1");
+		if (IsElement(parser, "Name"))
+			ParseName(parser, scope.name);
+		else if (IsElement(parser, "FullName"))
+			ParseName(parser, scope.full_name);
+		else if (IsElement(parser, "Namespaces"))
+		{
+			if (&scope == parser.deferred_scope)
+				DeferNamespaces(parser, scope);
+			else
+				ParseCollection<Namespace>(parser, AllocChildren(parser, scope).namespaces, &scope, "Namespace", ParseNamespace);
+		}
+		else if (IsElement(parser, "BaseTypes"))
+			ParseCollection<BaseType>(parser, AllocChildren(parser, scope).base_types, &scope, "BaseType", ParseBaseType);
+		else if (IsElement(parser, "Classes"))
+			ParseCollection<Class>(parser, AllocChildren(parser, scope).classes, &scope, "Class", ParseClass);
+		else if (IsElement(parser, "Templates"))
+			ParseCollection<Template>(parser, AllocChildren(parser, scope).templates, &scope, "Template", ParseTemplate);
+		else if (IsElement(parser, "TemplateInstances"))
+			ParseCollection<TemplateInstance>(parser, AllocChildren(parser, scope).template_instances, &scope, "TemplateInstance", ParseTemplateInstance);
+		else if (IsElement(parser, "Enums"))
+			ParseCollection<Enum>(parser, AllocChildren(parser, scope).enums, &scope, "Enum", ParseEnum);
+		else if (IsElement(parser, "Functions"))
+			ParseCollection<Function>(parser, AllocChildren(parser, scope).functions, &scope, "Function", ParseFunction);
+		else
+			return false;
 
-		ParseType(node, instance, parent_scope);
+		return true;
 	}
 
 
-	void ParseEnumEntry(TiXmlNode* node, Enum::Entry& entry, Scope* parent_scope)
+	bool ParseNamespaceElement(XmlDbParser& parser, Namespace& ns, Scope*)
 	{
-		ParseName(node, "Name", entry.name);
-		ParseInteger(node, "Value", entry.value);
+		return ParseScopeElement(parser, ns);
 	}
 
 
-	void ParseEnum(TiXmlNode* node, Enum& enm, Scope* parent_scope)
+	void ParseNamespace(XmlDbParser& parser, Namespace& ns, Scope* parent_scope)
 	{
-		enm.type = MakePatchableTypePtr("rfl::Enum");
-		ParseCollection(node, enm.entries, &enm, "Entries", "Entry", ParseEnumEntry);
-		ParseType(node, enm, parent_scope);
+		SetMetaType(parser, ns, META_NAMESPACE);
+		ns.parent_scope = parent_scope;
+		ParseElements(parser, ns, parent_scope, ParseNamespaceElement);
 	}
 
 
-	// These functions search through the loaded database looking for type definitions and adding
-	// them to the type map, using the type name hash ID as the key. This is done as a post-process
-	// as resizing a vector changes the address of the type objects.
-	// TODO: This is not ideal - need to come up with a better ownership strategy that's not too
-	// memory inefficient.
-
-
-	void PopulateTypeMapType(TypeMap& type_map, Type& type)
+	bool ParseTypeElement(XmlDbParser& parser, Type& type)
 	{
-		type_map[type.full_name.hash_id] = &type;
+		if (IsElement(parser, "UniqueID"))
+			ParseInteger(parser, type.unique_id);
+		else if (IsElement(parser, "Size"))
+			ParseInteger(parser, type.size);
+		else if (IsElement(parser, "TypeOfVA"))
+			ParseInteger(parser, type.typeof_va);
+
+		// Function indices are converted to pointers once the type's functions are loaded
+		else if (IsElement(parser, "ConstructorIndex"))
+			ParseInteger(parser, type.constructor);
+		else if (IsElement(parser, "DestructorIndex"))
+			ParseInteger(parser, type.destructor);
+		else if (IsElement(parser, "CopyConstructorIndex"))
+			ParseInteger(parser, type.copy_constructor);
+		else if (IsElement(parser, "AssignmentOperatorIndex"))
+			ParseInteger(parser, type.assignment_operator);
+
+		else
+			return ParseScopeElement(parser, type);
 
-		PopulateTypeMapScope(type_map, type);
+		return true;
 	}
 
 
-	template <typename COLLECTION, typename FUNCTION> void PopulateTypeMapCollection(TypeMap& type_map, COLLECTION& collection, FUNCTION function)
+	bool ParseBaseTypeElement(XmlDbParser& parser, BaseType& type, Scope*)
 	{
-		for (size_t i = 0; i < collection.size(); i++)
-			function(type_map, collection[i]);
+		return ParseTypeElement(parser, type);
 	}
 
 
-	void PopulateTypeMapScope(TypeMap& type_map, Scope& scope)
+	void ParseBaseType(XmlDbParser& parser, BaseType& type, Scope* parent_scope)
 	{
-		PopulateTypeMapCollection(type_map, scope.base_types, PopulateTypeMapType);
-		PopulateTypeMapCollection(type_map, scope.classes, PopulateTypeMapType);
-		PopulateTypeMapCollection(type_map, scope.templates, PopulateTypeMapType);
-		PopulateTypeMapCollection(type_map, scope.template_instances, PopulateTypeMapType);
-		PopulateTypeMapCollection(type_map, scope.enums, PopulateTypeMapType);
-		PopulateTypeMapCollection(type_map, scope.namespaces, PopulateTypeMapScope);
+		SetMetaType(parser, type, META_BASE_TYPE);
+		type.parent_scope = parent_scope;
+		ParseElements(parser, type, parent_scope, ParseBaseTypeElement);
+		AddType(parser, type);
 	}
 
 
-	// These functions use a constructed type map to map from the type name hash ID to the final type pointer. Even if the types weren't
-	// stored by value in vectors this would be necessary, as it resolves circular references between types.
+	bool ParseClassElement(XmlDbParser& parser, Class& cls, Scope*)
+	{
+		if (IsElement(parser, "IsPOD"))
+			cls.is_pod = ParseBool(parser);
+		else if (IsElement(parser, "BaseClasses"))
+			ParseCollection<Class::BaseClass>(parser, cls.base_classes, &cls, "BaseClass", ParseBaseClass);
+		else if (IsElement(parser, "Fields"))
+			ParseCollection<Field>(parser, cls.fields, &cls, "Field", ParseField);
+		else
+			return ParseTypeElement(parser, cls);
+
+		return true;
+	}
 
 
-	template <typename TYPE> void PatchPointer(TypeMap& type_map, TYPE*& type)
+	void ParseClass(XmlDbParser& parser, Class& cls, Scope* parent_scope)
 	{
-		if (type)
-			type = (TYPE*)type_map[(u32&)type];
+		SetMetaType(parser, cls, META_CLASS);
+		cls.parent_scope = parent_scope;
+		ParseElements(parser, cls, parent_scope, ParseClassElement);
+		AddType(parser, cls);
+		parser.classes.push_back(&cls);
 	}
 
 
-	void PatchTypePointersParameter(TypeMap& type_map, Parameter& parameter)
+	bool ParseTemplateElement(XmlDbParser& parser, Template& templ, Scope*)
 	{
-		PatchPointer(type_map, parameter.type);
+		return ParseTypeElement(parser, templ);
 	}
 
-	void PatchTypePointersBaseType(TypeMap& type_map, BaseType& base_type)
+
+	void ParseTemplate(XmlDbParser& parser, Template& templ, Scope* parent_scope)
 	{
-		PatchPointer(type_map, base_type.type);
+		SetMetaType(parser, templ, META_TEMPLATE);
+		templ.parent_scope = parent_scope;
+		ParseElements(parser, templ, parent_scope, ParseTemplateElement);
+		AddType(parser, templ);
 	}
 
-	void PatchTypePointersTemplate(TypeMap& type_map, Template& templ)
+
+	bool ParseTemplateInstanceElement(XmlDbParser& parser, TemplateInstance& instance, Scope*)
 	{
-		PatchPointer(type_map, templ.type);
+		if (IsElement(parser, "InstanceOf"))
+			ParseType(parser, (const Type*&)instance.instance_of);
+		else if (IsElement(parser, "Type0"))
+			ParseType(parser, instance.type0);
+		else if (IsElement(parser, "Type1"))
+			ParseType(parser, instance.type1);
+		else
+			return ParseTypeElement(parser, instance);
+
+		return true;
 	}
 
-	void PatchTypePointersTemplateInstance(TypeMap& type_map, TemplateInstance& instance)
+
+	void ParseTemplateInstance(XmlDbParser& parser, TemplateInstance& instance, Scope* parent_scope)
 	{
-		PatchPointer(type_map, instance.type);
-		PatchPointer(type_map, instance.instance_of);
-		PatchPointer(type_map, instance.type0);
-		PatchPointer(type_map, instance.type1);
+		SetMetaType(parser, instance, META_TEMPLATE_INSTANCE);
+		instance.parent_scope = parent_scope;
+
+		// Elements for missing type references aren't written
+		instance.instance_of = 0;
+		instance.type0 = 0;
+		instance.type1 = 0;
+
+		ParseElements(parser, instance, parent_scope, ParseTemplateInstanceElement);
+		AddType(parser, instance);
 	}
 
-	void PatchTypePointersEnum(TypeMap& type_map, Enum& enum_type)
+
+	bool ParseEnumEntryElement(XmlDbParser& parser, Enum::Entry& entry, Scope*)
 	{
-		PatchPointer(type_map, enum_type.type);
+		if (IsElement(parser, "Name"))
+			ParseName(parser, entry.name);
+		else if (IsElement(parser, "Value"))
+			ParseInteger(parser, entry.value);
+		else
+			return false;
+
+		return true;
 	}
 
-	template <typename COLLECTION, typename FUNCTION> void PatchTypePointersCollection(TypeMap& type_map, COLLECTION& collection, FUNCTION function)
+
+	void ParseEnumEntry(XmlDbParser& parser, Enum::Entry& entry, Scope* parent_scope)
 	{
-		for (size_t i = 0; i < collection.size(); i++)
-			function(type_map, collection[i]);
+		ParseElements(parser, entry, parent_scope, ParseEnumEntryElement);
 	}
 
 
-	void PatchTypePointersFunction(TypeMap& type_map, Function& function)
+	bool ParseEnumElement(XmlDbParser& parser, Enum& enm, Scope*)
 	{
-		PatchTypePointersParameter(type_map, function.return_parameter);
-		PatchTypePointersCollection(type_map, function.parameters, PatchTypePointersParameter);
+		if (IsElement(parser, "Entries"))
+		{
+			ParseCollection(parser, enm.entries, &enm, "Entry", ParseEnumEntry);
+			return true;
+		}
+
+		return ParseTypeElement(parser, enm);
 	}
 
 
-	void PatchTypePointersClass(TypeMap& type_map, Class& cls)
+	void ParseEnum(XmlDbParser& parser, Enum& enm, Scope* parent_scope)
 	{
-		PatchTypePointersCollection(type_map, cls.fields, PatchTypePointersParameter);
-		PatchTypePointersScope(type_map, cls);
+		SetMetaType(parser, enm, META_ENUM);
+		enm.parent_scope = parent_scope;
+		ParseElements(parser, enm, parent_scope, ParseEnumElement);
+		AddType(parser, enm);
 	}
 
 
-	void PatchTypePointersScope(TypeMap& type_map, Scope& scope)
+	void InitParser(XmlDbParser& parser, std::vector<CollectionCount>& counts, Arena* arena, TypeIndex* type_index, const NamePool* names, NamePool* new_names)
 	{
-		scope.type = type_map[(u32&)scope.type];
-
-		PatchTypePointersCollection(type_map, scope.base_types, PatchTypePointersBaseType);
-		PatchTypePointersCollection(type_map, scope.classes, PatchTypePointersClass);
-		PatchTypePointersCollection(type_map, scope.templates, PatchTypePointersTemplate);
-		PatchTypePointersCollection(type_map, scope.template_instances, PatchTypePointersTemplateInstance);
-		PatchTypePointersCollection(type_map, scope.enums, PatchTypePointersEnum);
-		PatchTypePointersCollection(type_map, scope.functions, PatchTypePointersFunction);
-		PatchTypePointersCollection(type_map, scope.namespaces, PatchTypePointersScope);
+		static const char* meta_type_names[NB_META_TYPES] =
+		{
+			"rfl::Namespace",
+			"rfl::BaseType",
+			"rfl::Class",
+			"rfl::Template",
+			"rfl::TemplateInstance",
+			"rfl::Enum",
+		};
+
+		parser.counts = &counts;
+		parser.next_count = 0;
+		parser.nb_types = 0;
+		parser.module = 0;
+		parser.arena = arena;
+		parser.type_index = type_index;
+		parser.names = names;
+		parser.new_names = new_names;
+		parser.load_names = true;
+		parser.deferred_scope = 0;
+		parser.jobs = 0;
+
+		for (int i = 0; i < NB_META_TYPES; i++)
+			parser.meta_type_hashes[i] = Name(meta_type_names[i]).hash_id;
 	}
 
 
-	void UpdateFunctionPtr(const Function*& function, const Type* type)
+	void ParseNamespaceJob(void* data, u32 index, u32 worker_index)
 	{
-		// This is a nasty bit of code
-		// Have to get function pointers last as everything is stored by-value in vectors
-		// BAD IDEA to store pointers to objects in a vector and this entire file exhibits this issue
-
-		int& index = (int&)function;
-		if (index == -1)
-			function = 0;
-		else
-			function = &type->functions[index];
+		ParallelParse& parse = *(ParallelParse*)data;
+		const NamespaceJob& job = (*parse.jobs)[index];
+		XmlDbParser& parser = (*parse.workers)[worker_index].parser;
+
+		// Resume reading the file from the namespace's start tag, keeping any error from the worker's
+		// earlier jobs as the job's reader state starts without one
+		bool error = parser.error;
+		(XmlReader&)parser = job.reader;
+		parser.next_count = FindFirstCollectionCount(*parser.counts, job.reader.pos);
+		ParseNamespace(parser, *job.ns, job.parent_scope);
+		parser.error |= error;
 	}
 
 
-	void UpdateModulePointers(TypeMap& type_map)
+	void ParseNamespaceJobs(XmlDbParser& parser, std::vector<NamespaceJob>& jobs, Module& module)
 	{
-		u64 base_address = Win32::GetProgramBaseAddress();
+		if (jobs.empty())
+			return;
+
+		// Each worker thread gets its own arena and type index so that no locks are needed
+		u32 nb_workers = Win32::GetNbWorkers();
+		if (nb_workers > jobs.size())
+			nb_workers = (u32)jobs.size();
+		std::vector<NamespaceWorker> workers(nb_workers);
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			InitParser(workers[i].parser, *parser.counts, &workers[i].arena, &workers[i].types, parser.names, &workers[i].names);
+			workers[i].parser.module = parser.module;
+			workers[i].parser.load_names = parser.load_names;
+		}
+
+		ParallelParse parse = { &jobs, &workers };
+		Win32::ParallelFor((u32)jobs.size(), ParseNamespaceJob, &parse);
 
-		for (TypeMap::iterator i = type_map.begin(); i != type_map.end(); ++i)
+		// Merge everything the workers created into the module, ready for patching
+		for (size_t i = 0; i < workers.size(); i++)
 		{
-			Type* type = i->second;
+			NamespaceWorker& worker = workers[i];
+			parser.error |= worker.parser.error;
+			module.arena.Adopt(worker.arena);
 
-			// Only patch types which have been requested in source code
-			if (type->typeof_va)
+			for (size_t j = 0; j < worker.types.entries.size(); j++)
 			{
-				// Figure out where the Type* pointer is in memory and update it
-				u64 offset = type->typeof_va + base_address;
-				Type** type_ptr = (Type**)offset;
-				*type_ptr = type;
+				const TypeIndex::Entry& entry = worker.types.entries[j];
+				if (entry.type)
+					module.types.Add(entry.hash_id, entry.type);
 			}
 
-			UpdateFunctionPtr(type->constructor, type);
-			UpdateFunctionPtr(type->destructor, type);
-			UpdateFunctionPtr(type->copy_constructor, type);
-			UpdateFunctionPtr(type->assignment_operator, type);
+			for (size_t j = 0; j < worker.names.entries.size(); j++)
+			{
+				const NamePool::Entry& entry = worker.names.entries[j];
+				if (entry.string)
+					module.names.Add(entry.hash_id, entry.string);
+			}
+
+			parser.fixups.insert(parser.fixups.end(), worker.parser.fixups.begin(), worker.parser.fixups.end());
+			parser.classes.insert(parser.classes.end(), worker.parser.classes.begin(), worker.parser.classes.end());
+		}
+	}
+
 
-			// for matching
+	void PatchTypePointers(XmlDbParser& parser)
+	{
+		// Every type has been indexed so the fixups can be applied in one linear pass
+		for (size_t i = 0; i < parser.fixups.size(); i++)
+		{
+			const TypeFixup& fixup = parser.fixups[i];
+			*fixup.type_ptr = parser.module->ResolveType(parser.type_index->Find(fixup.hash_id));
+		}
+
+		for (size_t i = 0; i < parser.classes.size(); i++)
+		{
+			parser.classes[i]->BuildFieldTable(*parser.arena);
+			parser.classes[i]->BuildHierarchy(*parser.arena);
 		}
 	}
 }
 
 
-Module* XmlDbReader::LoadModule(const char* xml_file)
+Module* XmlDbReader::LoadModule(const char* xml_file, u32 flags, LoadStats* stats, const ModuleBinding* binding)
 {
-	// Try to open the document
-	TiXmlDocument xml_doc;
-	if (!xml_doc.LoadFile(xml_file))
+	LoadStats local_stats;
+	LoadStats& load_stats = stats ? *stats : local_stats;
+	load_stats.BeginLoad();
+
+	// Map the file into memory so that it can be parsed in-place
+	u32 file_size = 0;
+	const char* data = (const char*)Win32::MapFile(xml_file, file_size);
+	load_stats.EndPhase(LoadStats::PHASE_MAP_FILE);
+	if (data == 0)
+	{
+		load_stats.EndLoad(xml_file, 0);
 		return 0;
-
-	// Search for the global namespace
-	if (TiXmlNode* root_node = xml_doc.FirstChild("RflDb"))
+	}
+	load_stats.bytes_read = file_size;
+
+	// The first pass counts the entries in every collection
+	std::vector<CollectionCount> counts;
+	XmlDbParser parser;
+	InitParser(parser, counts, 0, 0, 0, 0);
+	InitReader(parser, data, file_size);
+	if (ReadChildElement(parser) && IsElement(parser, "RflDb"))
+		CountCollections(parser);
+	load_stats.EndPhase(LoadStats::PHASE_SCAN);
+
+	// The second pass builds the module, searching for the name table and global namespace
+	Module* module = 0;
+	std::vector<NamespaceJob> jobs;
+	InitReader(parser, data, file_size);
+	parser.next_count = 0;
+	if (!parser.error && ReadChildElement(parser) && IsElement(parser, "RflDb"))
 	{
-		if (TiXmlNode* global_ns_node = root_node->FirstChild("Namespace"))
+		ModuleBinding default_binding;
+		module = new Module;
+		(binding ? binding : &default_binding)->Bind(*module);
+		module->types.Reserve(parser.nb_types);
+		parser.module = module;
+		parser.arena = &module->arena;
+		parser.type_index = &module->types;
+		parser.names = &module->names;
+		parser.new_names = &module->names;
+		parser.load_names = !(flags & LOAD_NO_NAMES);
+
+		bool found_global_namespace = false;
+		while (ReadChildElement(parser))
 		{
-			// Parse the file
-			Module* module = new Module;
-			ParseNamespace(global_ns_node, module->global_namespace, 0);
-
-			// Populate type map after all collections have been finalised
-			TypeMap type_map;
-			PopulateTypeMapScope(type_map, module->global_namespace);
-			PatchTypePointersScope(type_map, module->global_namespace);
-			UpdateModulePointers(type_map);
+			if (parser.load_names && IsElement(parser, "Names"))
+			{
+				ParseNames(parser, module->names);
+			}
+			else if (!found_global_namespace && IsElement(parser, "Namespace"))
+			{
+				// Parse the file
+				found_global_namespace = true;
+
+				// Children of the global namespace are independent subtrees that can be handed to workers
+				if (flags & LOAD_PARALLEL)
+				{
+					parser.deferred_scope = &module->global_namespace;
+					parser.jobs = &jobs;
+				}
+
+				ParseNamespace(parser, module->global_namespace, 0);
+				ParseNamespaceJobs(parser, jobs, *module);
+			}
+			else
+			{
+				SkipElement(parser);
+			}
+		}
 
-			return module;
+		// There's nothing to load without a global namespace
+		if (!found_global_namespace)
+		{
+			delete module;
+			module = 0;
 		}
 	}
 
-	return 0;
-}
\ No newline at end of file
+	Win32::UnmapFile(data);
+	if (module && !parser.error)
+		module->global_namespace.BuildNameIndexes(module->arena);
+	load_stats.EndPhase(LoadStats::PHASE_BUILD);
+
+	// Truncated or malformed files are rejected as a whole
+	if (parser.error)
+	{
+		delete module;
+		load_stats.EndLoad(xml_file, 0);
+		return 0;
+	}
+
+	if (module)
+	{
+		PatchTypePointers(parser);
+		module->type_hash.Build(module->arena, module->types);
+		module->BuildTypeTraits();
+		load_stats.EndPhase(LoadStats::PHASE_PATCH_TYPES);
+
+		if (!(flags & LOAD_NO_TYPEOF_PATCH))
+			UpdateTypeOfPointers(*module);
+		load_stats.EndPhase(LoadStats::PHASE_UPDATE_MODULE_POINTERS);
+	}
+
+	load_stats.EndLoad(xml_file, module);
+	return module;
+}
@@ -1,14 +1,30 @@
 
 #pragma once
 
+#include "Core.h"
+
 
 namespace rfl
 {
 	struct Module;
+	struct LoadStats;
+	struct ModuleBinding;
 
 
 	struct XmlDbReader
 	{
-		static Module* LoadModule(const char* xml_file);
+		enum Flags
+		{
+			// Parse the namespaces inside the global namespace on a pool of worker threads
+			LOAD_PARALLEL = 1,
+
+			// Don't point the TypeOf pointers in the program at the loaded types
+			LOAD_NO_TYPEOF_PATCH = 2,
+
+			// Leave the module's debug string pool empty, with only name hashes loaded
+			LOAD_NO_NAMES = 8,
+		};
+
+		static Module* LoadModule(const char* xml_file, u32 flags = 0, LoadStats* stats = 0, const ModuleBinding* binding = 0);
 	};
 }
\ No newline at end of file
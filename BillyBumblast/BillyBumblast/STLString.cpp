@@ -3,20 +3,20 @@
 #include "BinarySerialiser.h"
 
 
-void SerialiseSTLString(const rfl::Type* type, const void* object, std::ostream& ostream)
+void SerialiseSTLString(const rfl::Type* type, const void* object, serialise::Writer& writer)
 {
 	const std::string& str = *(std::string*)object;
 	int length = (int)str.length();
-	serialise::Write(ostream, length);
-	ostream.write(str.c_str(), length);
+	writer.Write(length);
+	writer.Write(str.c_str(), length);
 }
 
 
-void DeserialiseSTLString(const rfl::Type* type, void* object, std::istream& istream)
+void DeserialiseSTLString(const rfl::Type* type, void* object, serialise::Reader& reader)
 {
 	std::string& str = *(std::string*)object;
-	int length = serialise::Read<int>(istream);
+	int length = reader.Read<int>();
 	str.resize(length);
 	// NOTE: Naughty const-cast
-	istream.read((char*)str.data(), length);
+	reader.Read((char*)str.data(), length);
 }
@@ -3,7 +3,6 @@
 
 
 #include <string>
-#include <iosfwd>
 
 
 namespace rfl
@@ -12,5 +11,12 @@ namespace rfl
 }
 
 
-void SerialiseSTLString(const rfl::Type* type, const void* object, std::ostream& ostream);
-void DeserialiseSTLString(const rfl::Type* type, void* object, std::istream& istream);
+namespace serialise
+{
+	struct Writer;
+	struct Reader;
+}
+
+
+void SerialiseSTLString(const rfl::Type* type, const void* object, serialise::Writer& writer);
+void DeserialiseSTLString(const rfl::Type* type, void* object, serialise::Reader& reader);
@@ -16,26 +16,29 @@ int STLVector::GetSize(const rfl::Type* type) const
 }
 
 
-void STLVector::Serialise(const rfl::Type* type, const void* object, std::ostream& ostream)
+void STLVector::Serialise(const rfl::Type* type, const void* object, serialise::Writer& writer)
 {
 	STLVector& vec = *(STLVector*)object;
 
 	const rfl::TemplateInstance* instance_type = static_cast<const rfl::TemplateInstance*>(type);
 	const rfl::Type* object_type = instance_type->type0;
 
+	// Lazily loaded element types have no constructor or destructor until they're materialised
+	object_type->Materialise();
+
 	int size = vec.GetSize(object_type);
-	serialise::Write(ostream, size);
+	writer.Write(size);
 
-	if (object_type->constructor == 0)
+	if (!(object_type->traits & rfl::Type::TRAIT_NEEDS_CONSTRUCT))
 	{
 		if (size)
-			ostream.write(vec._Myfirst, object_type->size * size);
+			writer.Write(vec._Myfirst, object_type->size * size);
 	}
 
 	else
 	{
 		for (int i = 0; i < size; i++)
-			serialise::BinarySerialiseObject(vec._Myfirst + i * object_type->size, object_type, ostream);
+			serialise::BinarySerialiseObject(vec._Myfirst + i * object_type->size, object_type, writer);
 	}
 }
 
@@ -45,7 +48,8 @@ void STLVector::Delete(const rfl::Type* object_type)
 	if (_Myfirst)
 	{
 		// Destruct each object if needed
-		if (object_type->destructor)
+		object_type->Materialise();
+		if (object_type->traits & rfl::Type::TRAIT_NEEDS_DESTRUCT)
 		{
 			int size = GetSize(object_type);
 			for (int i = 0; i < size; i++)
@@ -70,7 +74,8 @@ void STLVector::New(const rfl::Type* object_type, int size)
 		_Myend = _Myfirst + data_size;
 
 		// Construct each new object if needed
-		if (object_type->constructor)
+		object_type->Materialise();
+		if (object_type->traits & rfl::Type::TRAIT_NEEDS_CONSTRUCT)
 		{
 			for (int i = 0; i < size; i++)
 				object_type->constructor->Call(_Myfirst + i * object_type->size);
@@ -78,26 +83,80 @@ void STLVector::New(const rfl::Type* object_type, int size)
 	}
 }
 
-void STLVector::Deserialise(const rfl::Type* type, void* object, std::istream& istream)
+void STLVector::Deserialise(const rfl::Type* type, void* object, serialise::Reader& reader)
 {
 	STLVector& vec = *(STLVector*)object;
 
 	const rfl::TemplateInstance* instance_type = static_cast<const rfl::TemplateInstance*>(type);
 	const rfl::Type* object_type = instance_type->type0;
 
+	// Lazily loaded element types have no constructor or destructor until they're materialised
+	object_type->Materialise();
+
 	// When deserialising to a vector, delete the old one before starting anew
-	int size = serialise::Read<int>(istream);
+	int size = reader.Read<int>();
 	vec.Delete(object_type);
 	vec.New(object_type, size);
 
-	if (object_type->constructor == 0 && size)
+	if (!(object_type->traits & rfl::Type::TRAIT_NEEDS_CONSTRUCT) && size)
 	{
-		istream.read(vec._Myfirst, object_type->size * size);
+		reader.Read(vec._Myfirst, object_type->size * size);
 	}
 
 	else
 	{
 		for (int i = 0; i < size; i++)
-			serialise::BinaryDeserialiseObject(vec._Myfirst + i * object_type->size, object_type, istream);
+			serialise::BinaryDeserialiseObject(vec._Myfirst + i * object_type->size, object_type, reader);
+	}
+}
+
+
+void STLVector::DeserialiseView(const rfl::Type* type, void* object, serialise::Reader& reader)
+{
+	STLVector& vec = *(STLVector*)object;
+
+	const rfl::TemplateInstance* instance_type = static_cast<const rfl::TemplateInstance*>(type);
+	const rfl::Type* object_type = instance_type->type0;
+
+	// Lazily loaded element types have no constructor or destructor until they're materialised
+	object_type->Materialise();
+
+	if (object_type->traits & rfl::Type::TRAIT_NEEDS_CONSTRUCT)
+	{
+		Deserialise(type, object, reader);
+		return;
+	}
+
+	int size = reader.Read<int>();
+	vec.Delete(object_type);
+
+	// Readers with a source have no memory of their own to point into so the data is copied
+	int data_size = object_type->size * size;
+	const void* data = data_size ? reader.ReadView(data_size) : 0;
+	if (data)
+	{
+		vec._Myfirst = (char*)data;
+		vec._Mylast = vec._Myfirst + data_size;
+		vec._Myend = vec._Myfirst + data_size;
+	}
+
+	else
+	{
+		vec.New(object_type, size);
+		if (data_size)
+			reader.Read(vec._Myfirst, data_size);
+	}
+}
+
+
+void STLVector::ReleaseView(const rfl::Type* type, void* object, const serialise::Reader& reader)
+{
+	// Vectors that were copied own their memory and are left alone
+	STLVector& vec = *(STLVector*)object;
+	if (vec._Myfirst && reader.Contains(vec._Myfirst))
+	{
+		vec._Myfirst = 0;
+		vec._Mylast = 0;
+		vec._Myend = 0;
 	}
 }
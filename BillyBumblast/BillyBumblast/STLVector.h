@@ -3,7 +3,6 @@
 
 
 #include <vector>
-#include <iosfwd>
 
 
 namespace rfl
@@ -12,17 +11,30 @@ namespace rfl
 }
 
 
+namespace serialise
+{
+	struct Writer;
+	struct Reader;
+}
+
+
 struct STLVector : public std::vector<char>
 {
 	int GetCapacity(const rfl::Type* type) const;
 
 	int GetSize(const rfl::Type* type) const;
 
-	static void Serialise(const rfl::Type* type, const void* object, std::ostream& ostream);
+	static void Serialise(const rfl::Type* type, const void* object, serialise::Writer& writer);
 
 	void Delete(const rfl::Type* object_type);
 
 	void New(const rfl::Type* object_type, int size);
 
-	static void Deserialise(const rfl::Type* type, void* object, std::istream& istream);
+	static void Deserialise(const rfl::Type* type, void* object, serialise::Reader& reader);
+
+	// Vectors of objects that don't need constructing point straight into the reader's memory, and
+	// must be released before they're destroyed
+	static void DeserialiseView(const rfl::Type* type, void* object, serialise::Reader& reader);
+
+	static void ReleaseView(const rfl::Type* type, void* object, const serialise::Reader& reader);
 };
\ No newline at end of file
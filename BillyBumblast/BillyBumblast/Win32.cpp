@@ -4,6 +4,37 @@
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
+
+
+namespace
+{
+	void* MapFileView(const char* filename, u32& size, DWORD protect, DWORD access)
+	{
+		HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		if (file == INVALID_HANDLE_VALUE)
+			return 0;
+
+		// Empty files can't be mapped
+		size = GetFileSize(file, 0);
+		HANDLE mapping = 0;
+		if (size != 0 && size != INVALID_FILE_SIZE)
+			mapping = CreateFileMappingA(file, 0, protect, 0, 0, 0);
+
+		// The view keeps the mapping and file alive until it's unmapped
+		void* data = 0;
+		if (mapping)
+		{
+			data = MapViewOfFile(mapping, access, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+
+		CloseHandle(file);
+		return data;
+	}
+}
 
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nShowCmd)
@@ -21,4 +52,209 @@ int main(int argc, char* argv[])
 u64 Win32::GetProgramBaseAddress()
 {
 	return (u64)GetModuleHandle(0);
-}
\ No newline at end of file
+}
+
+
+u64 Win32::GetModuleBaseAddress(const char* module_name)
+{
+	return (u64)GetModuleHandleA(module_name);
+}
+
+const void* Win32::MapFile(const char* filename, u32& size)
+{
+	return MapFileView(filename, size, PAGE_READONLY, FILE_MAP_READ);
+}
+
+
+void* Win32::MapFileCopyOnWrite(const char* filename, u32& size)
+{
+	return MapFileView(filename, size, PAGE_WRITECOPY, FILE_MAP_COPY);
+}
+
+
+void Win32::UnmapFile(const void* data)
+{
+	UnmapViewOfFile(data);
+}
+
+
+void* Win32::AllocCode(u32 size)
+{
+	return VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+
+bool Win32::ProtectCode(void* code, u32 size)
+{
+	DWORD old_protect;
+	if (!VirtualProtect(code, size, PAGE_EXECUTE_READ, &old_protect))
+		return false;
+	return FlushInstructionCache(GetCurrentProcess(), code, size) != 0;
+}
+
+
+void Win32::FreeCode(void* code)
+{
+	VirtualFree(code, 0, MEM_RELEASE);
+}
+
+
+u64 Win32::GetFileTimestamp(const char* filename)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes))
+		return 0;
+
+	return ((u64)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+}
+
+
+u64 Win32::GetTicks()
+{
+	LARGE_INTEGER ticks;
+	QueryPerformanceCounter(&ticks);
+	return ticks.QuadPart;
+}
+
+
+double Win32::TicksToMs(u64 ticks)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return (double)ticks * 1000.0 / (double)frequency.QuadPart;
+}
+
+
+u64 Win32::GetMemoryUsage()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.WorkingSetSize;
+}
+
+
+u64 Win32::GetPeakMemoryUsage()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+}
+
+
+void Win32::AtomicAdd(volatile u64& value, u64 amount)
+{
+	// There's no 64-bit add on 32-bit targets so retry until no other thread has changed the value
+	LONGLONG old_value;
+	do
+	{
+		old_value = value;
+	}
+	while (InterlockedCompareExchange64((volatile LONGLONG*)&value, old_value + amount, old_value) != old_value);
+}
+
+
+u32 Win32::AtomicIncrement(volatile u32& value)
+{
+	return InterlockedIncrement((volatile LONG*)&value);
+}
+
+
+u32 Win32::AtomicCompareExchange(volatile u32& value, u32 exchange, u32 comparand)
+{
+	return InterlockedCompareExchange((volatile LONG*)&value, exchange, comparand);
+}
+
+
+void* Win32::AtomicExchangePointer(void* volatile& ptr, void* value)
+{
+	return InterlockedExchangePointer(&ptr, value);
+}
+
+
+void Win32::YieldThread()
+{
+	SwitchToThread();
+}
+
+
+namespace
+{
+	struct ParallelForJob
+	{
+		Win32::ParallelFunc func;
+		void* data;
+		u32 count;
+
+		// Index of the last call claimed by a worker
+		volatile LONG next_index;
+	};
+
+
+	struct ParallelForWorker
+	{
+		ParallelForJob* job;
+		u32 worker_index;
+	};
+
+
+	DWORD WINAPI ParallelForThread(void* param)
+	{
+		ParallelForWorker* worker = (ParallelForWorker*)param;
+		ParallelForJob* job = worker->job;
+
+		// Keep claiming calls until there are none left
+		while (true)
+		{
+			u32 index = (u32)InterlockedIncrement(&job->next_index);
+			if (index >= job->count)
+				break;
+			job->func(job->data, index, worker->worker_index);
+		}
+
+		return 0;
+	}
+}
+
+
+u32 Win32::GetNbWorkers()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+}
+
+
+void Win32::ParallelFor(u32 count, ParallelFunc func, void* data)
+{
+	ParallelForJob job = { func, data, count, -1 };
+
+	// No more threads than there are calls, with the calling thread acting as the first worker
+	const u32 max_workers = MAXIMUM_WAIT_OBJECTS;
+	u32 nb_workers = GetNbWorkers();
+	if (nb_workers > count)
+		nb_workers = count;
+	if (nb_workers > max_workers)
+		nb_workers = max_workers;
+
+	ParallelForWorker workers[max_workers];
+	HANDLE threads[max_workers];
+	u32 nb_threads = 0;
+	for (u32 i = 1; i < nb_workers; i++)
+	{
+		workers[i].job = &job;
+		workers[i].worker_index = i;
+		if (HANDLE thread = CreateThread(0, 0, ParallelForThread, &workers[i], 0, 0))
+			threads[nb_threads++] = thread;
+	}
+
+	workers[0].job = &job;
+	workers[0].worker_index = 0;
+	ParallelForThread(&workers[0]);
+
+	if (nb_threads)
+		WaitForMultipleObjects(nb_threads, threads, TRUE, INFINITE);
+	for (u32 i = 0; i < nb_threads; i++)
+		CloseHandle(threads[i]);
+}
@@ -1,4 +1,3 @@
-
 #pragma once
 
 
@@ -10,4 +9,54 @@ namespace Win32
 	int Main(int argc, const char** argv);
 
 	u64 GetProgramBaseAddress();
-}
\ No newline at end of file
+
+	// Base address of a DLL loaded into the process, or 0 if it's not loaded
+	u64 GetModuleBaseAddress(const char* module_name);
+
+	// Maps an entire file into memory for reading, returning 0 on failure
+	const void* MapFile(const char* filename, u32& size);
+
+	// Maps a file so that the memory can be written to without the changes reaching the file, with
+	// pages only copied as they're written to. Unmapped with UnmapFile.
+	void* MapFileCopyOnWrite(const char* filename, u32& size);
+
+	void UnmapFile(const void* data);
+
+	// Allocates memory for code to be written to, returning 0 on failure
+	void* AllocCode(u32 size);
+
+	// Make code written to memory from AllocCode executable, after which it can't be written to
+	bool ProtectCode(void* code, u32 size);
+
+	void FreeCode(void* code);
+
+	// Last modification time of a file, or 0 if it doesn't exist
+	u64 GetFileTimestamp(const char* filename);
+
+	// High resolution timer
+	u64 GetTicks();
+	double TicksToMs(u64 ticks);
+
+	// Working set of the process and the largest it's been since the process started, in bytes
+	u64 GetMemoryUsage();
+	u64 GetPeakMemoryUsage();
+
+	// Adds to a value that may be shared between threads
+	void AtomicAdd(volatile u64& value, u64 amount);
+
+	// Atomic operations that also act as full memory barriers
+	u32 AtomicIncrement(volatile u32& value);
+	u32 AtomicCompareExchange(volatile u32& value, u32 exchange, u32 comparand);
+	void* AtomicExchangePointer(void* volatile& ptr, void* value);
+
+	// Give up the rest of the thread's time slice while spinning
+	void YieldThread();
+
+	// Number of threads ParallelFor can run at once
+	u32 GetNbWorkers();
+
+	// Calls func for every index in [0, count) on a pool of worker threads, returning once all calls
+	// have completed. Each call is passed the index of the worker running it.
+	typedef void (*ParallelFunc)(void* data, u32 index, u32 worker_index);
+	void ParallelFor(u32 count, ParallelFunc func, void* data);
+}
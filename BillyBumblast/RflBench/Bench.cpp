@@ -0,0 +1,387 @@
+
+#include "RflDbGenerator.h"
+#include "Rfl.h"
+#include "RflXmlDbReader.h"
+#include "RflBinDbReader.h"
+#include "RflBinDbWriter.h"
+#include "RflModuleRegistry.h"
+#include "Win32.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//
+// Measures how module loading scales with the size of the reflection database. Databases are generated
+// at multiples of the production size and loaded in every format, writing one CSV row per scale and
+// format to stdout (or the -out file). Each database is first checked to convert to binary correctly
+// when loaded as a second module through a registry.
+//
+// Usage:
+//    RflBench [-scales 1,10,100] [-runs 3] [-out results.csv]
+//             [-namespaces N] [-classes N] [-fields N] [-instances N] [-enums N] [-entries N]
+//
+// Database shape options are per namespace, except -namespaces, and are applied before scaling.
+//
+
+
+namespace
+{
+	// Heap allocations made through new, which covers every std container the loaders use
+	volatile u64 g_HeapAllocations = 0;
+	volatile u64 g_HeapBytes = 0;
+
+
+	void* CountedAlloc(size_t size)
+	{
+		Win32::AtomicAdd(g_HeapAllocations, 1);
+		Win32::AtomicAdd(g_HeapBytes, size);
+		return malloc(size ? size : 1);
+	}
+
+
+	struct Format
+	{
+		const char* name;
+		bool binary;
+		u32 flags;
+	};
+
+
+	const Format g_Formats[] =
+	{
+		{ "xml", false, 0 },
+		{ "xml_parallel", false, rfl::XmlDbReader::LOAD_PARALLEL },
+		{ "bin", true, 0 },
+		{ "bin_lazy", true, rfl::BinDbReader::LOAD_LAZY },
+		{ "bin_no_names", true, rfl::BinDbReader::LOAD_NO_NAMES },
+	};
+
+
+	struct Options
+	{
+		Options() : runs(3), out_file(0)
+		{
+		}
+
+		std::vector<u32> scales;
+		u32 runs;
+		const char* out_file;
+		rfl::GeneratorConfig config;
+	};
+
+
+	struct Result
+	{
+		rfl::LoadStats stats;
+		u64 heap_allocations;
+		u64 heap_bytes;
+		u64 working_set_bytes;
+		u64 peak_working_set_bytes;
+	};
+
+
+	void ParseScales(const char* text, std::vector<u32>& scales)
+	{
+		scales.clear();
+		while (*text)
+		{
+			char* end;
+			u32 scale = strtoul(text, &end, 10);
+			if (end == text)
+				break;
+			if (scale)
+				scales.push_back(scale);
+			text = *end == ',' ? end + 1 : end;
+		}
+	}
+
+
+	bool ParseOptions(int argc, const char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			// Every option takes a value
+			if (i + 1 >= argc)
+				return false;
+
+			const char* option = argv[i];
+			const char* value = argv[++i];
+			u32 number = strtoul(value, 0, 10);
+
+			if (!strcmp(option, "-scales"))
+				ParseScales(value, options.scales);
+			else if (!strcmp(option, "-runs"))
+				options.runs = number ? number : 1;
+			else if (!strcmp(option, "-out"))
+				options.out_file = value;
+			else if (!strcmp(option, "-namespaces"))
+				options.config.nb_namespaces = number;
+			else if (!strcmp(option, "-classes"))
+				options.config.nb_classes = number;
+			else if (!strcmp(option, "-fields"))
+				options.config.nb_fields_per_class = number;
+			else if (!strcmp(option, "-instances"))
+				options.config.nb_template_instances = number;
+			else if (!strcmp(option, "-enums"))
+				options.config.nb_enums = number;
+			else if (!strcmp(option, "-entries"))
+				options.config.nb_entries_per_enum = number;
+			else
+				return false;
+		}
+
+		if (options.scales.empty())
+		{
+			options.scales.push_back(1);
+			options.scales.push_back(10);
+			options.scales.push_back(100);
+		}
+
+		return true;
+	}
+
+
+	rfl::Module* LoadModule(const Format& format, const char* xml_file, const char* bin_file, rfl::LoadStats* stats)
+	{
+		if (format.binary)
+			return rfl::BinDbReader::LoadModule(bin_file, format.flags, stats);
+		return rfl::XmlDbReader::LoadModule(xml_file, format.flags, stats);
+	}
+
+
+	bool MeasureLoad(const Format& format, const char* xml_file, const char* bin_file, Result& result)
+	{
+		u64 working_set = Win32::GetMemoryUsage();
+		g_HeapAllocations = 0;
+		g_HeapBytes = 0;
+
+		rfl::Module* module = LoadModule(format, xml_file, bin_file, &result.stats);
+		if (module == 0)
+			return false;
+
+		// Measured while the module is still loaded. The peak working set can't be reset so is only
+		// meaningful for scales run in increasing order.
+		result.heap_allocations = g_HeapAllocations;
+		result.heap_bytes = g_HeapBytes;
+		result.working_set_bytes = Win32::GetMemoryUsage() - working_set;
+		result.peak_working_set_bytes = Win32::GetPeakMemoryUsage();
+
+		rfl::UnloadModule(module);
+		return true;
+	}
+
+
+	// Count the type references in a module that are null: meta types and the types of fields
+	u32 CountNullTypeRefs(const rfl::Module& module)
+	{
+		u32 nb_null = 0;
+		for (size_t i = 0; i < module.types.entries.size(); i++)
+		{
+			const rfl::Type* type = module.types.entries[i].type;
+			if (type == 0)
+				continue;
+
+			if (type->type == 0)
+				nb_null++;
+
+			if (type->kind == rfl::Type::KIND_CLASS)
+			{
+				const rfl::Class* cls = static_cast<const rfl::Class*>(type);
+				for (u32 j = 0; j < cls->fields.count; j++)
+				{
+					if (cls->fields[j].type == 0)
+						nb_null++;
+				}
+			}
+		}
+
+		return nb_null;
+	}
+
+
+	// Load the database as two modules through a registry, as the executable and a plugin would be, and
+	// then again from the binary databases written by the first load. The second module's references are
+	// resolved to the first module's types, so both loads must leave it with no more unresolved references
+	// than the database has when loaded on its own.
+	bool CheckSharedTypeRefs(const char* xml_file)
+	{
+		rfl::Module* single = rfl::XmlDbReader::LoadModule(xml_file);
+		if (single == 0)
+			return false;
+		u32 nb_expected_null = CountNullTypeRefs(*single);
+		rfl::UnloadModule(single);
+
+		const char* bin_files[2] = { "RflBench_shared0.rflbin", "RflBench_shared1.rflbin" };
+		remove(bin_files[0]);
+		remove(bin_files[1]);
+
+		u32 nb_null[2];
+		for (u32 i = 0; i < 2; i++)
+		{
+			rfl::ModuleRegistry registry;
+			rfl::Module* module = registry.LoadModule(xml_file, bin_files[0], 0);
+			rfl::Module* plugin = module ? registry.LoadModule(xml_file, bin_files[1], 0) : 0;
+			if (plugin == 0)
+				return false;
+			nb_null[i] = CountNullTypeRefs(*plugin);
+		}
+
+		remove(bin_files[0]);
+		remove(bin_files[1]);
+		return nb_null[0] == nb_expected_null && nb_null[1] == nb_expected_null;
+	}
+
+
+	void WriteHeader(FILE* fp)
+	{
+		fprintf(fp,
+			"scale,format,namespaces,file_bytes,types,fields,load_ms,us_per_type,"
+			"map_ms,scan_ms,build_ms,patch_types_ms,update_module_pointers_ms,"
+			"heap_allocations,heap_bytes,arena_allocations,arena_bytes,"
+			"working_set_bytes,peak_working_set_bytes,type_index_load_factor\n");
+	}
+
+
+	void WriteResult(FILE* fp, u32 scale, const Format& format, const rfl::GeneratorConfig& config, const Result& result)
+	{
+		const rfl::LoadStats& stats = result.stats;
+		double us_per_type = stats.nb_types ? stats.total_ms * 1000.0 / stats.nb_types : 0;
+
+		fprintf(fp, "%u,%s,%u,%I64u,%u,%u,%.3f,%.3f,", scale, format.name, config.nb_namespaces,
+			stats.bytes_read, stats.nb_types, stats.nb_fields, stats.total_ms, us_per_type);
+		fprintf(fp, "%.3f,%.3f,%.3f,%.3f,%.3f,",
+			stats.phase_ms[rfl::LoadStats::PHASE_MAP_FILE],
+			stats.phase_ms[rfl::LoadStats::PHASE_SCAN],
+			stats.phase_ms[rfl::LoadStats::PHASE_BUILD],
+			stats.phase_ms[rfl::LoadStats::PHASE_PATCH_TYPES],
+			stats.phase_ms[rfl::LoadStats::PHASE_UPDATE_MODULE_POINTERS]);
+		fprintf(fp, "%I64u,%I64u,%u,%I64u,%I64u,%I64u,%.3f\n",
+			result.heap_allocations, result.heap_bytes, stats.nb_allocations, stats.allocated_bytes,
+			result.working_set_bytes, result.peak_working_set_bytes, stats.type_index_load_factor);
+		fflush(fp);
+	}
+
+
+	bool RunScale(FILE* fp, const Options& options, u32 scale)
+	{
+		rfl::GeneratorConfig config = options.config.Scaled(scale);
+
+		char xml_file[64], bin_file[64];
+		sprintf(xml_file, "RflBench_x%u.xml", scale);
+		sprintf(bin_file, "RflBench_x%u.rflbin", scale);
+
+		if (!rfl::XmlDbGenerator::WriteDatabase(xml_file, config))
+		{
+			fprintf(stderr, "Failed to write %s\n", xml_file);
+			return false;
+		}
+
+		// The binary database is converted from the XML, as it would be on first run
+		rfl::Module* module = rfl::XmlDbReader::LoadModule(xml_file);
+		bool converted = module && rfl::BinDbWriter::WriteModule(module, bin_file);
+		if (module)
+			rfl::UnloadModule(module);
+		if (!converted)
+		{
+			fprintf(stderr, "Failed to convert %s to %s\n", xml_file, bin_file);
+			return false;
+		}
+
+		if (!CheckSharedTypeRefs(xml_file))
+		{
+			fprintf(stderr, "Type references to other modules were lost converting %s\n", xml_file);
+			return false;
+		}
+
+		for (u32 i = 0; i < sizeof(g_Formats) / sizeof(g_Formats[0]); i++)
+		{
+			// Report the fastest run to reduce noise from the rest of the system
+			Result best;
+			bool loaded = false;
+			for (u32 j = 0; j < options.runs; j++)
+			{
+				Result result;
+				if (!MeasureLoad(g_Formats[i], xml_file, bin_file, result))
+					break;
+				if (!loaded || result.stats.total_ms < best.stats.total_ms)
+					best = result;
+				loaded = true;
+			}
+
+			if (!loaded)
+			{
+				fprintf(stderr, "Failed to load %s at scale %u\n", g_Formats[i].name, scale);
+				return false;
+			}
+
+			WriteResult(fp, scale, g_Formats[i], config, best);
+		}
+
+		remove(xml_file);
+		remove(bin_file);
+		return true;
+	}
+}
+
+
+void* operator new(size_t size)
+{
+	return CountedAlloc(size);
+}
+
+
+void* operator new[](size_t size)
+{
+	return CountedAlloc(size);
+}
+
+
+void operator delete(void* ptr)
+{
+	free(ptr);
+}
+
+
+void operator delete[](void* ptr)
+{
+	free(ptr);
+}
+
+
+int Win32::Main(int argc, const char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		fprintf(stderr, "Usage: RflBench [-scales 1,10,100] [-runs N] [-out file.csv] [-namespaces N] [-classes N] [-fields N] [-instances N] [-enums N] [-entries N]\n");
+		return 1;
+	}
+
+	FILE* fp = stdout;
+	if (options.out_file)
+	{
+		fp = fopen(options.out_file, "w");
+		if (fp == 0)
+		{
+			fprintf(stderr, "Failed to open %s\n", options.out_file);
+			return 1;
+		}
+	}
+
+	WriteHeader(fp);
+
+	int status = 0;
+	for (size_t i = 0; i < options.scales.size(); i++)
+	{
+		if (!RunScale(fp, options, options.scales[i]))
+		{
+			status = 1;
+			break;
+		}
+	}
+
+	if (fp != stdout)
+		fclose(fp);
+	return status;
+}
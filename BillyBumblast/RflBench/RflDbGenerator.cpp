@@ -0,0 +1,467 @@
+
+#include "RflDbGenerator.h"
+#include <cstdio>
+#include <set>
+
+using namespace rfl;
+
+
+namespace
+{
+	// Meta types the loaders point every scope at
+	const char* g_MetaTypeNames[] =
+	{
+		"Namespace",
+		"BaseType",
+		"Class",
+		"Template",
+		"TemplateInstance",
+		"Enum",
+	};
+
+
+	struct BaseTypeDesc
+	{
+		const char* name;
+		u32 size;
+	};
+
+
+	const BaseTypeDesc g_BaseTypes[] =
+	{
+		{ "int", 4 },
+		{ "float", 4 },
+		{ "bool", 1 },
+		{ "void", 0 },
+	};
+
+
+	//
+	// The database is walked twice: once to write the name table that comes first in the file and
+	// once to write the scope tree that references it
+	//
+	enum Pass
+	{
+		PASS_NAMES,
+		PASS_TREE
+	};
+
+
+	struct Generator
+	{
+		FILE* fp;
+		Pass pass;
+		u32 depth;
+		u32 unique_id;
+		const GeneratorConfig* config;
+
+		// Names already written to the name table
+		std::set<u32> names;
+	};
+
+
+	void WriteIndent(Generator& gen)
+	{
+		for (u32 i = 0; i < gen.depth; i++)
+			fputs("  ", gen.fp);
+	}
+
+
+	void WriteEscaped(Generator& gen, const char* text)
+	{
+		for (const char* c = text; *c; c++)
+		{
+			switch (*c)
+			{
+			case '<': fputs("&lt;", gen.fp); break;
+			case '>': fputs("&gt;", gen.fp); break;
+			case '&': fputs("&amp;", gen.fp); break;
+			case '"': fputs("&quot;", gen.fp); break;
+			default: fputc(*c, gen.fp); break;
+			}
+		}
+	}
+
+
+	void OpenElement(Generator& gen, const char* tag)
+	{
+		if (gen.pass == PASS_TREE)
+		{
+			WriteIndent(gen);
+			fprintf(gen.fp, "<%s>\n", tag);
+		}
+		gen.depth++;
+	}
+
+
+	void CloseElement(Generator& gen, const char* tag)
+	{
+		gen.depth--;
+		if (gen.pass == PASS_TREE)
+		{
+			WriteIndent(gen);
+			fprintf(gen.fp, "</%s>\n", tag);
+		}
+	}
+
+
+	void WriteText(Generator& gen, const char* tag, const char* text)
+	{
+		if (gen.pass == PASS_TREE)
+		{
+			WriteIndent(gen);
+			fprintf(gen.fp, "<%s>%s</%s>\n", tag, text, tag);
+		}
+	}
+
+
+	void WriteInt(Generator& gen, const char* tag, int value)
+	{
+		char text[16];
+		sprintf(text, "%d", value);
+		WriteText(gen, tag, text);
+	}
+
+
+	void WriteBool(Generator& gen, const char* tag, bool value)
+	{
+		WriteText(gen, tag, value ? "True" : "False");
+	}
+
+
+	void WriteNameElement(Generator& gen, const char* tag, const char* str, u32 hash_id)
+	{
+		WriteIndent(gen);
+		fprintf(gen.fp, "<%s str=\"", tag);
+		WriteEscaped(gen, str);
+		fprintf(gen.fp, "\">%u</%s>\n", hash_id, tag);
+	}
+
+
+	void WriteName(Generator& gen, const char* tag, const char* str)
+	{
+		u32 hash_id = Name(str).hash_id;
+
+		// Names and type references are written to the name table the first time they're seen
+		if (gen.pass == PASS_NAMES)
+		{
+			if (gen.names.insert(hash_id).second)
+			{
+				u32 depth = gen.depth;
+				gen.depth = 2;
+				WriteNameElement(gen, "Name", str, hash_id);
+				gen.depth = depth;
+			}
+		}
+		else
+		{
+			WriteNameElement(gen, tag, str, hash_id);
+		}
+	}
+
+
+	void WriteScopeNames(Generator& gen, const char* name, const char* full_name)
+	{
+		WriteName(gen, "Name", name);
+		WriteName(gen, "FullName", full_name);
+	}
+
+
+	void WriteTypeHeader(Generator& gen, const char* name, const char* full_name, u32 size)
+	{
+		WriteScopeNames(gen, name, full_name);
+		WriteInt(gen, "UniqueID", gen.unique_id++);
+		WriteInt(gen, "Size", size);
+		WriteInt(gen, "TypeOfVA", 0);
+	}
+
+
+	void WriteNoFunctions(Generator& gen)
+	{
+		WriteInt(gen, "ConstructorIndex", -1);
+		WriteInt(gen, "DestructorIndex", -1);
+		WriteInt(gen, "CopyConstructorIndex", -1);
+		WriteInt(gen, "AssignmentOperatorIndex", -1);
+	}
+
+
+	void WriteField(Generator& gen, const char* name, const char* type, bool is_pointer, u32 offset)
+	{
+		OpenElement(gen, "Field");
+		WriteName(gen, "Name", name);
+		WriteName(gen, "Type", type);
+		WriteBool(gen, "IsConst", false);
+		WriteText(gen, "Modifier", is_pointer ? "Pointer" : "Value");
+		WriteInt(gen, "Offset", offset);
+		CloseElement(gen, "Field");
+	}
+
+
+	void WriteBaseClass(Generator& gen, const char* ns, u32 index, u32 offset)
+	{
+		char type[128];
+		sprintf(type, "%s::Class%u", ns, index);
+
+		OpenElement(gen, "BaseClass");
+		WriteName(gen, "Type", type);
+		WriteInt(gen, "Offset", offset);
+		CloseElement(gen, "BaseClass");
+	}
+
+
+	void WriteClass(Generator& gen, const char* ns, u32 index)
+	{
+		const GeneratorConfig& config = *gen.config;
+
+		char name[64], full_name[128];
+		sprintf(name, "Class%u", index);
+		sprintf(full_name, "%s::%s", ns, name);
+
+		OpenElement(gen, "Class");
+		WriteTypeHeader(gen, name, full_name, config.nb_fields_per_class * 4);
+		WriteNoFunctions(gen);
+		WriteBool(gen, "IsPOD", true);
+
+		// The classes of each namespace form a binary tree along their first base class, with every
+		// fourth class also deriving from the class before it
+		if (index)
+		{
+			OpenElement(gen, "BaseClasses");
+			WriteBaseClass(gen, ns, (index - 1) / 2, 0);
+			if (index % 4 == 3)
+				WriteBaseClass(gen, ns, index - 1, 4);
+			CloseElement(gen, "BaseClasses");
+		}
+
+		// Cycle through base types, enums and pointers to other classes so that every kind of type
+		// reference gets resolved
+		if (config.nb_fields_per_class)
+		{
+			OpenElement(gen, "Fields");
+			for (u32 i = 0; i < config.nb_fields_per_class; i++)
+			{
+				char field_name[64], type[128];
+				sprintf(field_name, "field%u", i);
+
+				bool is_pointer = false;
+				switch (i % 4)
+				{
+				case 0:
+					sprintf(type, "int");
+					break;
+				case 1:
+					sprintf(type, "float");
+					break;
+				case 2:
+					if (config.nb_enums)
+						sprintf(type, "%s::Enum%u", ns, i % config.nb_enums);
+					else
+						sprintf(type, "bool");
+					break;
+				case 3:
+					sprintf(type, "%s::Class%u", ns, (index + 1) % config.nb_classes);
+					is_pointer = true;
+					break;
+				}
+
+				WriteField(gen, field_name, type, is_pointer, i * 4);
+			}
+			CloseElement(gen, "Fields");
+		}
+
+		CloseElement(gen, "Class");
+	}
+
+
+	void WriteTemplateInstance(Generator& gen, const char* ns, u32 index)
+	{
+		const GeneratorConfig& config = *gen.config;
+
+		// Instances of a fixed-length array template so that every instance has a unique name
+		char type0[128], name[192], full_name[256];
+		if (config.nb_classes)
+			sprintf(type0, "%s::Class%u", ns, index % config.nb_classes);
+		else
+			sprintf(type0, "int");
+		sprintf(name, "Array<%s,%u>", type0, index + 1);
+		sprintf(full_name, "%s::%s", ns, name);
+
+		OpenElement(gen, "TemplateInstance");
+		WriteTypeHeader(gen, name, full_name, 4 * (index + 1));
+		WriteNoFunctions(gen);
+		WriteName(gen, "InstanceOf", "Array");
+		WriteName(gen, "Type0", type0);
+		CloseElement(gen, "TemplateInstance");
+	}
+
+
+	void WriteEnum(Generator& gen, const char* ns, u32 index)
+	{
+		const GeneratorConfig& config = *gen.config;
+
+		char name[64], full_name[128];
+		sprintf(name, "Enum%u", index);
+		sprintf(full_name, "%s::%s", ns, name);
+
+		OpenElement(gen, "Enum");
+		WriteTypeHeader(gen, name, full_name, 4);
+
+		if (config.nb_entries_per_enum)
+		{
+			OpenElement(gen, "Entries");
+			for (u32 i = 0; i < config.nb_entries_per_enum; i++)
+			{
+				char entry_name[64];
+				sprintf(entry_name, "VALUE_%u", i);
+
+				OpenElement(gen, "Entry");
+				WriteName(gen, "Name", entry_name);
+				WriteInt(gen, "Value", i);
+				CloseElement(gen, "Entry");
+			}
+			CloseElement(gen, "Entries");
+		}
+
+		CloseElement(gen, "Enum");
+	}
+
+
+	void WriteNamespace(Generator& gen, u32 index)
+	{
+		const GeneratorConfig& config = *gen.config;
+
+		char ns[32];
+		sprintf(ns, "ns%u", index);
+
+		OpenElement(gen, "Namespace");
+		WriteScopeNames(gen, ns, ns);
+
+		if (config.nb_classes)
+		{
+			OpenElement(gen, "Classes");
+			for (u32 i = 0; i < config.nb_classes; i++)
+				WriteClass(gen, ns, i);
+			CloseElement(gen, "Classes");
+		}
+
+		if (config.nb_template_instances)
+		{
+			OpenElement(gen, "TemplateInstances");
+			for (u32 i = 0; i < config.nb_template_instances; i++)
+				WriteTemplateInstance(gen, ns, i);
+			CloseElement(gen, "TemplateInstances");
+		}
+
+		if (config.nb_enums)
+		{
+			OpenElement(gen, "Enums");
+			for (u32 i = 0; i < config.nb_enums; i++)
+				WriteEnum(gen, ns, i);
+			CloseElement(gen, "Enums");
+		}
+
+		CloseElement(gen, "Namespace");
+	}
+
+
+	void WriteMetaTypes(Generator& gen)
+	{
+		OpenElement(gen, "Namespace");
+		WriteScopeNames(gen, "rfl", "rfl");
+
+		OpenElement(gen, "Classes");
+		for (u32 i = 0; i < sizeof(g_MetaTypeNames) / sizeof(g_MetaTypeNames[0]); i++)
+		{
+			char full_name[64];
+			sprintf(full_name, "rfl::%s", g_MetaTypeNames[i]);
+
+			OpenElement(gen, "Class");
+			WriteTypeHeader(gen, g_MetaTypeNames[i], full_name, 64);
+			WriteNoFunctions(gen);
+			WriteBool(gen, "IsPOD", false);
+			CloseElement(gen, "Class");
+		}
+		CloseElement(gen, "Classes");
+
+		CloseElement(gen, "Namespace");
+	}
+
+
+	void WriteGlobalNamespace(Generator& gen)
+	{
+		gen.unique_id = 0;
+
+		OpenElement(gen, "Namespace");
+		WriteScopeNames(gen, "Global", "Global");
+
+		OpenElement(gen, "Namespaces");
+		WriteMetaTypes(gen);
+		for (u32 i = 0; i < gen.config->nb_namespaces; i++)
+			WriteNamespace(gen, i);
+		CloseElement(gen, "Namespaces");
+
+		OpenElement(gen, "BaseTypes");
+		for (u32 i = 0; i < sizeof(g_BaseTypes) / sizeof(g_BaseTypes[0]); i++)
+		{
+			OpenElement(gen, "BaseType");
+			WriteTypeHeader(gen, g_BaseTypes[i].name, g_BaseTypes[i].name, g_BaseTypes[i].size);
+			CloseElement(gen, "BaseType");
+		}
+		CloseElement(gen, "BaseTypes");
+
+		OpenElement(gen, "Templates");
+		OpenElement(gen, "Template");
+		WriteTypeHeader(gen, "Array", "Array", 0);
+		CloseElement(gen, "Template");
+		CloseElement(gen, "Templates");
+
+		CloseElement(gen, "Namespace");
+	}
+}
+
+
+GeneratorConfig::GeneratorConfig()
+	: nb_namespaces(200)
+	, nb_classes(10)
+	, nb_template_instances(2)
+	, nb_enums(2)
+	, nb_fields_per_class(8)
+	, nb_entries_per_enum(8)
+{
+}
+
+
+GeneratorConfig GeneratorConfig::Scaled(u32 scale) const
+{
+	GeneratorConfig config = *this;
+	config.nb_namespaces *= scale;
+	return config;
+}
+
+
+bool XmlDbGenerator::WriteDatabase(const char* xml_file, const GeneratorConfig& config)
+{
+	Generator gen;
+	gen.fp = fopen(xml_file, "w");
+	if (gen.fp == 0)
+		return false;
+	gen.depth = 1;
+	gen.config = &config;
+
+	fputs("<RflDb>\n", gen.fp);
+
+	gen.pass = PASS_TREE;
+	OpenElement(gen, "Names");
+	gen.pass = PASS_NAMES;
+	WriteGlobalNamespace(gen);
+	gen.pass = PASS_TREE;
+	CloseElement(gen, "Names");
+
+	WriteGlobalNamespace(gen);
+
+	fputs("</RflDb>\n", gen.fp);
+
+	bool ok = ferror(gen.fp) == 0;
+	fclose(gen.fp);
+	return ok;
+}
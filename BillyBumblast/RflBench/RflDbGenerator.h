@@ -0,0 +1,42 @@
+
+#pragma once
+
+#include "Core.h"
+
+
+namespace rfl
+{
+	//
+	// Shape of a synthetic reflection database. Every generated namespace has the same contents so
+	// that the size of the database grows linearly with the namespace count.
+	//
+	struct GeneratorConfig
+	{
+		// Defaults to the size of a production database
+		GeneratorConfig();
+
+		// Multiply the number of namespaces
+		GeneratorConfig Scaled(u32 scale) const;
+
+		u32 nb_namespaces;
+
+		// Per namespace
+		u32 nb_classes;
+		u32 nb_template_instances;
+		u32 nb_enums;
+
+		u32 nb_fields_per_class;
+		u32 nb_entries_per_enum;
+	};
+
+
+	//
+	// Writes an RflDb XML database in the same format as the one generated from a program's PDB,
+	// including the rfl meta types. None of the types have functions or TypeOf pointers so the
+	// database can be loaded into any program.
+	//
+	struct XmlDbGenerator
+	{
+		static bool WriteDatabase(const char* xml_file, const GeneratorConfig& config);
+	};
+}